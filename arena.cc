@@ -0,0 +1,31 @@
+#include "arena.h"
+
+#include <algorithm>
+
+void* Arena::allocate(size_t size, size_t align) {
+  for (; current_ < blocks_.size(); ++current_, offset_ = 0) {
+    Block& b = blocks_[current_];
+    void* p = b.data.get() + offset_;
+    size_t space = b.size - offset_;
+    if (std::align(align, size, p, space)) {
+      offset_ = b.size - space + size;
+      return p;
+    }
+  }
+
+  const size_t bytes = std::max(block_, size + align);
+  blocks_.push_back({ std::make_unique<std::byte[]>(bytes), bytes });
+  offset_ = 0;
+  return allocate(size, align);
+}
+
+void Arena::reset() {
+  current_ = 0;
+  offset_ = 0;
+}
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const auto& b : blocks_) total += b.size;
+  return total;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for short lived things that all go away together.  Memory is
+// handed out in order from large blocks and only taken back all at once by
+// reset(), which keeps the blocks for next time, so once it has grown to the
+// biggest load it sees it never touches the heap again.
+class Arena {
+  public:
+
+    explicit Arena(size_t block = 64 * 1024) : block_(block), current_(0), offset_(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+
+    // Constructs a T in the arena.  Its destructor is not run by reset().
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+      return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void reset();
+
+    size_t capacity() const;
+
+  private:
+
+    struct Block {
+      std::unique_ptr<std::byte[]> data;
+      size_t size;
+    };
+
+    size_t block_;
+    std::vector<Block> blocks_;
+    size_t current_, offset_;
+};
@@ -0,0 +1,691 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "components.h"
+#include "config.h"
+#include "controls.h"
+#include "flocking.h"
+#include "framebuffer.h"
+#include "game_screen.h"
+#include "replay.h"
+#include "rng.h"
+#include "sound_events.h"
+#include "spatial_grid.h"
+
+// Runs the GameScreen systems headless with a fixed seed and timestep and
+// reports frame time percentiles as the number of boxes grows.
+//
+//   squarez_bench --boxes=1000,10000,100000 --frames=300 --seed=1 --timestep=16 --threads=8
+//
+// With --csv=stats.csv or --trace=trace.json the per-system profile of each
+// run is written out too, with the box count added to the file name.
+//
+// --check compares the packed flocking sums against a plain grid query at
+// each box count first and fails if they disagree.  It also checks Rng
+// against published Philox values and its batches against single draws.  --theta=X runs with
+// approximate flocking, and with --check also reports how far off it steers.
+// --budget=MS lets the game cut back on work to stay under MS per frame.
+//
+// --fire holds down fire and turn so boxes get shot and explode.  Once the
+// first second of frames is out of the way every heap allocation is counted:
+// allocs is how many there were in all and frame allocs the most in any one
+// frame.  Steady play should not allocate at all.  The
+// sound effects triggered per frame are reported next to the voices they
+// were mixed down to.
+//
+// --render draws every frame into a software framebuffer at the configured
+// size and scale and reports how long that takes, along with the pixels
+// covered per frame and how many full-screen layers went into how many fills.
+// With --golden=frame.ppm the last frame at each box count is compared pixel
+// for pixel against frame-1000.ppm and so on, and written there when there's
+// nothing yet.  A frame that differs is saved as frame-1000-actual.ppm and
+// fails the run.
+//
+// --counters reads the CPU's cycle, instruction, L1 and LLC miss and branch
+// miss counters around every system and draw pass where Linux allows it, and
+// prints them per box per frame.  Counters only see the thread a system runs
+// on, so everything runs on one thread while counting.
+//
+// --layout times a movement pass over each box count through plain views and
+// through an owning group, after churn has left the pools out of step.
+//
+// --replay=session.sqz plays back a session recorded with squarez --record
+// as fast as it will go instead, then prints the per-system times and a
+// checksum of the world.  --expect=HEX fails the run if the checksum differs,
+// so a change that alters how the game plays out shows up at once.  Builds
+// with different compilers or flags can round differently and disagree.
+//
+// --save=world.sqs snapshots the world after the last frame at each box count
+// to world-1000.sqs and so on.  --load=world.sqs starts each box count from
+// that snapshot instead of a fresh game and reports how long loading took.
+// With --replay the session plays out over world.sqs as named.
+
+namespace {
+  std::atomic<size_t> allocations(0);
+}
+
+// Every heap allocation in the process goes through here so the bench can
+// count them.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+  struct Settings {
+    std::vector<size_t> boxes = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+    size_t frames = 120;
+    unsigned int seed = 1;
+    unsigned int timestep = 16;
+    unsigned int threads = 0;
+    std::string csv, trace;
+    std::string replay, expect;
+    std::string save, load;
+    std::string golden;
+    float theta = 0.0f;
+    float budget = 0.0f;
+    bool check = false;
+    bool layout = false;
+    bool fire = false;
+    bool render = false;
+    bool counters = false;
+  };
+
+  bool flag(const std::string& arg, const std::string& name, std::string& value) {
+    const std::string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0) return false;
+    value = arg.substr(prefix.size());
+    return true;
+  }
+
+  Settings parse(int argc, char** argv) {
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      std::string value;
+
+      if (flag(arg, "boxes", value)) {
+        settings.boxes.clear();
+        std::stringstream list(value);
+        for (std::string n; std::getline(list, n, ',');) settings.boxes.push_back(std::stoul(n));
+      } else if (flag(arg, "frames", value)) {
+        settings.frames = std::stoul(value);
+      } else if (flag(arg, "seed", value)) {
+        settings.seed = std::stoul(value);
+      } else if (flag(arg, "timestep", value)) {
+        settings.timestep = std::stoul(value);
+      } else if (flag(arg, "threads", value)) {
+        settings.threads = std::stoul(value);
+      } else if (flag(arg, "csv", value)) {
+        settings.csv = value;
+      } else if (flag(arg, "trace", value)) {
+        settings.trace = value;
+      } else if (flag(arg, "budget", value)) {
+        settings.budget = std::stof(value);
+      } else if (flag(arg, "replay", value)) {
+        settings.replay = value;
+      } else if (flag(arg, "expect", value)) {
+        settings.expect = value;
+      } else if (flag(arg, "save", value)) {
+        settings.save = value;
+      } else if (flag(arg, "load", value)) {
+        settings.load = value;
+      } else if (flag(arg, "golden", value)) {
+        settings.golden = value;
+        settings.render = true;
+      } else if (flag(arg, "theta", value)) {
+        settings.theta = std::stof(value);
+      } else if (arg == "--check") {
+        settings.check = true;
+      } else if (arg == "--layout") {
+        settings.layout = true;
+      } else if (arg == "--fire") {
+        settings.fire = true;
+      } else if (arg == "--render") {
+        settings.render = true;
+      } else if (arg == "--counters") {
+        settings.counters = true;
+      } else {
+        std::fprintf(stderr, "usage: %s [--boxes=N,N,...] [--frames=N] [--seed=N] [--timestep=MS] [--threads=N] [--csv=FILE] [--trace=FILE] [--theta=X] [--budget=MS] [--check] [--layout] [--fire] [--render] [--golden=FILE] [--counters] [--replay=FILE] [--expect=HEX] [--save=FILE] [--load=FILE]\n", argv[0]);
+        std::exit(1);
+      }
+    }
+
+    return settings;
+  }
+
+  // stats.csv -> stats-actual.csv
+  std::string suffixed(const std::string& path, const std::string& suffix) {
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of('/');
+    const size_t split = dot == std::string::npos || (slash != std::string::npos && dot < slash) ? path.size() : dot;
+    return path.substr(0, split) + "-" + suffix + path.substr(split);
+  }
+
+  // stats.csv -> stats-1000.csv
+  std::string numbered(const std::string& path, size_t n) {
+    return suffixed(path, std::to_string(n));
+  }
+
+  double percentile(const std::vector<double>& sorted, double p) {
+    const size_t i = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::clamp(i, (size_t)1, sorted.size()) - 1];
+  }
+
+  // mean and percentiles of one column of frame times, sorting them
+  std::string summarize(std::vector<double>& times) {
+    double total = 0;
+    for (const double t : times) total += t;
+    std::sort(times.begin(), times.end());
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%10.3f %10.3f %10.3f %10.3f %10.3f",
+        total / times.size(), percentile(times, 0.50), percentile(times, 0.90), percentile(times, 0.99), times.back());
+    return line;
+  }
+
+  // Hardware counter totals divided out per frame and per entity, so runs
+  // with different box counts compare directly.
+  void print_counts(const std::vector<Profiler::Counts>& counts, size_t entities) {
+    const auto cell = [](size_t event, double value, int precision) {
+      if (Counters::counted(event)) {
+        std::printf(" %10.*f", precision, value);
+      } else {
+        std::printf(" %10s", "-");
+      }
+    };
+
+    std::printf("%-16s %10s %10s %6s %10s %10s %10s\n", "per box", "cycles", "instrs", "IPC", "L1 miss", "LLC miss", "br miss");
+    for (const auto& c : counts) {
+      if (c.samples == 0) continue;
+
+      const double per = (double)c.samples * std::max<size_t>(entities, 1);
+      const uint64_t cycles = c.totals[Counters::cycles];
+
+      std::printf("%-16s", c.name);
+      cell(Counters::cycles, cycles / per, 1);
+      cell(Counters::instructions, c.totals[Counters::instructions] / per, 1);
+      if (Counters::counted(Counters::instructions) && cycles > 0) {
+        std::printf(" %6.2f", (double)c.totals[Counters::instructions] / cycles);
+      } else {
+        std::printf(" %6s", "-");
+      }
+      cell(Counters::l1_misses, c.totals[Counters::l1_misses] / per, 3);
+      cell(Counters::llc_misses, c.totals[Counters::llc_misses] / per, 3);
+      cell(Counters::branch_misses, c.totals[Counters::branch_misses] / per, 3);
+      std::printf("\n");
+    }
+  }
+
+  // Compares the last frame drawn against its golden image, or makes it the
+  // golden image if there isn't one yet.
+  bool check_golden(const Framebuffer& frame, const std::string& path) {
+    Framebuffer golden(frame.width(), frame.height(), frame.scale());
+    if (!golden.read_ppm(path)) {
+      if (!frame.write_ppm(path)) {
+        std::fprintf(stderr, "unable to write %s\n", path.c_str());
+        return false;
+      }
+      std::printf("wrote golden image %s\n", path.c_str());
+      return true;
+    }
+
+    if (golden.pixels() == frame.pixels()) return true;
+
+    size_t differ = 0;
+    for (size_t i = 0; i < golden.pixels().size(); ++i) differ += golden.pixels()[i] != frame.pixels()[i];
+    std::fprintf(stderr, "%s: %zu pixels differ\n", path.c_str(), differ);
+    frame.write_ppm(suffixed(path, "actual"));
+    return false;
+  }
+
+  struct dpos { double x = 0, y = 0; };
+
+  // Relative to the total size of the terms that were summed, since sums that
+  // mostly cancel out can't be expected to keep their relative precision.
+  double error(const dpos expected, const pos actual, double scale) {
+    const double dx = expected.x - actual.x, dy = expected.y - actual.y;
+    return std::sqrt(dx * dx + dy * dy) / std::max(1.0, scale);
+  }
+
+  double mag(double x, double y) { return std::sqrt(x * x + y * y); }
+
+  struct Check {
+    bool counts_match = true;
+    double worst = 0;  // relative error of any one sum
+    double steering = 0, steering_error = 0;  // mean size of the steering change and its error
+  };
+
+  // Compares Flock's neighbor sums for n clustered random boids against the
+  // grid query GameScreen::flocking() used before it.  The grid sums are kept
+  // in double so the error measured is Flock's.  The steering change is
+  // weighed the way flocking() does it.
+  Check check_flocking(unsigned int seed, size_t n, float theta) {
+    constexpr float kSight = 75.0f, kCrowding = 20.0f;
+    const float width = kConfig.graphics.width, height = kConfig.graphics.height;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> px(0, width), py(0, height), v(-5, 5);
+    std::normal_distribution<float> spread(0, 40);
+
+    std::vector<pos> centers(16);
+    for (pos& c : centers) c = { px(rng), py(rng) };
+
+    std::vector<pos> ps(n), vs(n);
+    SpatialGrid grid(kSight, width, height);
+    Flock flock(kSight, kCrowding, width, height, theta);
+    for (size_t i = 0; i < n; ++i) {
+      const pos c = centers[i % centers.size()];
+      ps[i] = { std::clamp(c.x + spread(rng), 0.0f, width), std::clamp(c.y + spread(rng), 0.0f, height) };
+      vs[i] = { v(rng), v(rng) };
+      grid.insert((entt::entity)i, ps[i], vs[i]);
+      flock.add(ps[i], vs[i]);
+    }
+    grid.build();
+    flock.build();
+
+    Check check;
+    size_t steered = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const pos boid = ps[i];
+      int count = 0;
+      dpos center, heading, avoid;
+      double center_scale = 0, heading_scale = 0, avoid_scale = 0;
+
+      // Neighbors right on the edge of either radius can land either side of
+      // it depending on rounding, so such boids aren't held to exact sums.
+      bool edge = false;
+
+      grid.query(boid, kSight, [&](const SpatialGrid::Entry& other) {
+        if (other.e == (entt::entity)i) return;
+        const float d = other.p.dist2(boid);
+        for (const float r : { kSight, kCrowding }) {
+          if (std::abs(d - r * r) <= 1e-5f * r * r) edge = true;
+        }
+
+        if (d < kSight * kSight) {
+          ++count;
+          center.x += other.p.x;
+          center.y += other.p.y;
+          heading.x += other.v.x;
+          heading.y += other.v.y;
+          center_scale += mag(other.p.x - boid.x, other.p.y - boid.y);
+          heading_scale += mag(other.v.x, other.v.y);
+        }
+        if (d < kCrowding * kCrowding) {
+          avoid.x += boid.x - other.p.x;
+          avoid.y += boid.y - other.p.y;
+          avoid_scale += mag(boid.x - other.p.x, boid.y - other.p.y);
+        }
+      });
+
+      const Flock::Sums s = flock.sums(i);
+      if (!edge && s.count != count) check.counts_match = false;
+      if (count == 0 || s.count == 0) continue;
+
+      const dpos c { center.x / count - boid.x, center.y / count - boid.y };
+      const dpos h { heading.x / count, heading.y / count };
+      if (!edge) {
+        check.worst = std::max(check.worst, error(c, s.center / s.count, center_scale / count));
+        check.worst = std::max(check.worst, error(h, s.flock / s.count, heading_scale / count));
+        check.worst = std::max(check.worst, error(avoid, s.avoid, avoid_scale));
+      }
+
+      const dpos expected {
+        c.x * 0.005 + avoid.x * 0.05 + h.x * 0.05,
+        c.y * 0.005 + avoid.y * 0.05 + h.y * 0.05 };
+      const pos actual = s.center / s.count * 0.005f + s.avoid * 0.05f + s.flock / s.count * 0.05f;
+      const double ex = expected.x - actual.x, ey = expected.y - actual.y;
+
+      check.steering += std::sqrt(expected.x * expected.x + expected.y * expected.y);
+      check.steering_error += std::sqrt(ex * ex + ey * ey);
+      ++steered;
+    }
+
+    if (steered > 0) {
+      check.steering /= steered;
+      check.steering_error /= steered;
+    }
+
+    return check;
+  }
+
+  // Known answers for Philox4x32-10 from the Random123 distribution, then
+  // batches of every awkward length against the same draws made one at a
+  // time, with the stream part way through a block.
+  bool check_rng(unsigned int seed) {
+    struct Known { uint32_t counter[4], key[2], out[4]; };
+    static const Known known[] = {
+      { { 0, 0, 0, 0 }, { 0, 0 }, { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+      { { ~0u, ~0u, ~0u, ~0u }, { ~0u, ~0u }, { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+      { { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 },
+        { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } },
+    };
+
+    for (const Known& k : known) {
+      uint32_t out[4];
+      Rng::block(k.counter, k.key, out);
+      if (!std::equal(out, out + 4, k.out)) return false;
+    }
+
+    std::vector<float> batch(100);
+    for (size_t n = 0; n <= batch.size(); ++n) {
+      Rng a = Rng(seed).substream(n), b(seed, n);
+      a.next();
+      b.next();
+
+      a.fill(batch.data(), n, 1.5f, 4.5f);
+      for (size_t i = 0; i < n; ++i) {
+        if (batch[i] != b.uniform(1.5f, 4.5f)) return false;
+      }
+      if (a.next() != b.next()) return false;
+    }
+
+    return true;
+  }
+
+  // Fills reg with n movers the way a long game leaves them: created, half
+  // killed off at random and replaced, with the components added in a
+  // different order for each pool.
+  void churn(entt::registry& reg, unsigned int seed, size_t n) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> coord(0, 1000), v(-5, 5);
+
+    std::vector<entt::entity> es(n);
+    reg.create(es.begin(), es.end());
+
+    for (int round = 0; round < 3; ++round) {
+      std::shuffle(es.begin(), es.end(), rng);
+      for (size_t i = 0; i < n / 2; ++i) reg.destroy(es[i]);
+      for (size_t i = 0; i < n / 2; ++i) es[i] = reg.create();
+
+      for (const auto e : es) if (!reg.all_of<Position>(e)) reg.emplace<Position>(e, pos{ coord(rng), coord(rng) });
+      std::shuffle(es.begin(), es.end(), rng);
+      for (const auto e : es) if (!reg.all_of<Vector>(e)) reg.emplace<Vector>(e, pos{ v(rng), v(rng) });
+      std::shuffle(es.begin(), es.end(), rng);
+      for (const auto e : es) if (!reg.all_of<Previous>(e)) reg.emplace<Previous>(e);
+    }
+  }
+
+  // Best of several runs of a movement and remember pass, in ns per entity.
+  template <typename Movers>
+  double time_movers(Movers movers, size_t n) {
+    double best = INFINITY;
+    for (int run = 0; run < 20; ++run) {
+      const auto start = std::chrono::steady_clock::now();
+      for (const auto e : movers) {
+        pos& p = movers.template get<Position>(e).p;
+        const pos v = movers.template get<Vector>(e).v;
+        movers.template get<Previous>(e) = { p, v };
+        p += v;
+      }
+      const std::chrono::duration<double, std::nano> pass = std::chrono::steady_clock::now() - start;
+      best = std::min(best, pass.count() / n);
+    }
+    return best;
+  }
+
+  struct Layout { double view, group; };
+
+  Layout compare_layout(unsigned int seed, size_t n) {
+    entt::registry viewed, grouped;
+    grouped.group<Position, Vector, Previous>();
+
+    churn(viewed, seed, n);
+    churn(grouped, seed, n);
+
+    return {
+      time_movers(viewed.view<Position, Vector, Previous>(), n),
+      time_movers(grouped.group<Position, Vector, Previous>(), n) };
+  }
+}
+
+namespace {
+  // Everything but the log itself comes from its header, and the timing is
+  // left out of the way so that every tick does its whole share of work.
+  int replay(const Settings& settings) {
+    ReplayReader log;
+    if (!log.open(settings.replay)) {
+      std::fprintf(stderr, "unable to read replay %s\n", settings.replay.c_str());
+      return 1;
+    }
+
+    const ReplayHeader& header = log.header();
+    GameScreen::Options options{ header.seed, header.boxes };
+    options.tick = header.tick;
+    options.threads = settings.counters ? 1 : settings.threads;
+    options.counters = settings.counters;
+    GameScreen game(options);
+
+    if (!settings.load.empty() && !game.load(settings.load)) {
+      std::fprintf(stderr, "unable to load snapshot %s\n", settings.load.c_str());
+      return 1;
+    }
+
+    size_t frames = 0;
+    unsigned int elapsed;
+    Controls controls;
+
+    const auto start = std::chrono::steady_clock::now();
+    while (log.read(elapsed, controls)) {
+      game.replay(controls, elapsed);
+      ++frames;
+    }
+    const std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+
+    std::printf("%zu frames in %.1f ms\n", frames, total.count());
+    std::printf("%-16s %10s %10s %10s\n", "system", "min ms", "avg ms", "p99 ms");
+    for (const auto& s : game.profiler().stats()) {
+      std::printf("%-16s %10.3f %10.3f %10.3f\n", s.name, s.min, s.avg, s.p99);
+    }
+
+    if (game.profiler().counting()) {
+      std::printf("\nhardware counters per box per frame\n");
+      print_counts(game.profiler().counts(), header.boxes);
+    } else if (settings.counters) {
+      std::printf("\nhardware counters unavailable: %s\n", Counters::error());
+    }
+
+    if (!settings.csv.empty() && !game.profiler().write_csv(settings.csv)) {
+      std::fprintf(stderr, "unable to write %s\n", settings.csv.c_str());
+    }
+
+    const uint64_t checksum = game.checksum();
+    std::printf("checksum %016llx\n", (unsigned long long)checksum);
+
+    if (!settings.expect.empty() && std::stoull(settings.expect, nullptr, 16) != checksum) {
+      std::fprintf(stderr, "checksum does not match %s\n", settings.expect.c_str());
+      return 1;
+    }
+
+    return 0;
+  }
+}
+
+int main(int argc, char** argv) {
+  const Settings settings = parse(argc, argv);
+  if (!settings.replay.empty()) return replay(settings);
+  Controls input;
+  if (settings.fire) input.held = Controls::bit(Input::Button::A) | Controls::bit(Input::Button::Left);
+
+  // The approximation is expected to differ, so it is only reported.
+  if (settings.check) {
+    bool ok = check_rng(settings.seed);
+    std::printf("rng: %s\n", ok ? "ok" : "does not match");
+
+    for (const size_t boxes : settings.boxes) {
+      const Check exact = check_flocking(settings.seed, boxes, 0.0f);
+      std::printf("flocking %8zu boids: worst relative error %g\n", boxes, exact.worst);
+      if (!exact.counts_match || !(exact.worst < 1e-3)) ok = false;
+
+      if (settings.theta > 0) {
+        const Check approx = check_flocking(settings.seed, boxes, settings.theta);
+        std::printf("flocking %8zu boids: theta %g steering error %g of %g (%.2f%%)\n",
+            boxes, settings.theta, approx.steering_error, approx.steering, 100 * approx.steering_error / approx.steering);
+      }
+    }
+    if (!ok) {
+      std::fprintf(stderr, "checks failed\n");
+      return 1;
+    }
+  }
+
+  if (settings.layout) {
+    for (const size_t boxes : settings.boxes) {
+      const Layout layout = compare_layout(settings.seed, boxes);
+      std::printf("movers %8zu: view %.2f ns, group %.2f ns per entity\n", boxes, layout.view, layout.group);
+    }
+  }
+
+  std::vector<std::pair<size_t, std::string>> renders;
+  std::vector<std::pair<size_t, std::vector<Profiler::Counts>>> counts;
+  std::vector<std::pair<size_t, double>> loads;
+  std::vector<std::pair<size_t, std::string>> sounds;
+  bool golden = true;
+
+  std::printf("%8s %8s %10s %10s %10s %10s %10s %10s %12s\n", "boxes", "frames", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "allocs", "frame allocs");
+
+  for (const size_t boxes : settings.boxes) {
+    // The player can't die or the systems would stop running partway through.
+    GameScreen::Options options{ settings.seed, settings.load.empty() ? boxes : 0, INT_MAX };
+    options.threads = settings.counters ? 1 : settings.threads;
+    options.counters = settings.counters;
+    options.trace = !settings.trace.empty();
+    options.flock_theta = settings.theta;
+    options.budget = settings.budget;
+    options.capacity.boxes = boxes;
+    GameScreen game(options);
+
+    if (!settings.load.empty()) {
+      const auto start = std::chrono::steady_clock::now();
+      if (!game.load(numbered(settings.load, boxes))) {
+        std::fprintf(stderr, "unable to load snapshot %s\n", numbered(settings.load, boxes).c_str());
+        return 1;
+      }
+      const std::chrono::duration<double, std::milli> load = std::chrono::steady_clock::now() - start;
+      loads.emplace_back(boxes, load.count());
+    }
+
+    std::vector<double> times, draws;
+    times.reserve(settings.frames);
+    draws.reserve(settings.frames);
+
+    size_t pixels = 0, layers = 0, fills = 0;
+    const auto& graphics = kConfig.graphics;
+    Framebuffer framebuffer(settings.render ? graphics.width : 0, settings.render ? graphics.height : 0, graphics.intscale);
+
+    // the first second is left out of the count while everything warms up
+    const size_t warmup = std::min<size_t>(1000 / std::max(1u, settings.timestep), settings.frames);
+    size_t allocated = 0, most = 0;
+
+    for (size_t i = 0; i < settings.frames; ++i) {
+      const size_t before = allocations.load();
+      const auto start = std::chrono::steady_clock::now();
+      game.simulate(input, settings.timestep);
+      const std::chrono::duration<double, std::milli> frame = std::chrono::steady_clock::now() - start;
+      times.push_back(frame.count());
+
+      if (settings.render) {
+        const auto start = std::chrono::steady_clock::now();
+        game.render(framebuffer);
+        const std::chrono::duration<double, std::milli> draw = std::chrono::steady_clock::now() - start;
+        draws.push_back(draw.count());
+
+        const GameScreen::Fill& fill = game.fill();
+        pixels += fill.pixels;
+        layers += fill.layers;
+        fills += fill.fills;
+      }
+
+      if (i >= warmup) {
+        const size_t frame = allocations.load() - before;
+        allocated += frame;
+        most = std::max(most, frame);
+      }
+    }
+
+    if (times.empty()) continue;
+
+    std::printf("%8zu %8zu %s %10zu %12zu\n", boxes, times.size(), summarize(times).c_str(), allocated, most);
+    if (settings.render) {
+      char fill[64];
+      std::snprintf(fill, sizeof(fill), " %10.2f %10.2f %10.2f",
+          pixels / 1e6 / draws.size(), (double)layers / draws.size(), (double)fills / draws.size());
+      renders.emplace_back(boxes, summarize(draws) + fill);
+    }
+
+    if (game.profiler().counting()) counts.emplace_back(boxes, game.profiler().counts());
+
+    const SoundEvents& sound = game.sounds();
+    if (sound.triggers() > 0) {
+      char row[64];
+      std::snprintf(row, sizeof(row), "%10.2f %10.2f", (double)sound.triggers() / times.size(), (double)sound.voices() / times.size());
+      sounds.emplace_back(boxes, row);
+    }
+
+    if (!settings.golden.empty() && !check_golden(framebuffer, numbered(settings.golden, boxes))) golden = false;
+
+    if (!settings.save.empty() && !game.save(numbered(settings.save, boxes))) {
+      std::fprintf(stderr, "unable to write %s\n", numbered(settings.save, boxes).c_str());
+    }
+
+    if (!settings.csv.empty() && !game.profiler().write_csv(numbered(settings.csv, boxes))) {
+      std::fprintf(stderr, "unable to write %s\n", numbered(settings.csv, boxes).c_str());
+    }
+
+    if (!settings.trace.empty() && !game.profiler().write_trace(numbered(settings.trace, boxes))) {
+      std::fprintf(stderr, "unable to write %s\n", numbered(settings.trace, boxes).c_str());
+    }
+  }
+
+  if (settings.render) {
+    std::printf("\nrendered at %dx%d, scale %d\n", kConfig.graphics.width, kConfig.graphics.height, kConfig.graphics.intscale);
+    std::printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s\n", "boxes", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "Mpixels", "layers", "fills");
+    for (const auto& [boxes, row] : renders) std::printf("%8zu %s\n", boxes, row.c_str());
+  }
+
+  if (!sounds.empty()) {
+    std::printf("\nsounds per frame\n%8s %10s %10s\n", "boxes", "triggered", "voices");
+    for (const auto& [boxes, row] : sounds) std::printf("%8zu %s\n", boxes, row.c_str());
+  }
+
+  if (!loads.empty()) {
+    std::printf("\n%8s %10s\n", "boxes", "load ms");
+    for (const auto& [boxes, ms] : loads) std::printf("%8zu %10.3f\n", boxes, ms);
+  }
+
+  if (settings.counters && counts.empty()) {
+    std::printf("\nhardware counters unavailable: %s\n", Counters::error());
+  }
+  for (const auto& [boxes, c] : counts) {
+    std::printf("\n%zu boxes, hardware counters per box per frame\n", boxes);
+    print_counts(c, boxes);
+  }
+
+  if (!golden) {
+    std::fprintf(stderr, "frames differ from the golden images\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include "budget.h"
+
+#include <algorithm>
+
+namespace {
+  // how quickly the average follows new frames
+  constexpr float kSmoothing = 0.1f;
+
+  // Frames to wait after a change so the average can catch up with it before
+  // deciding again.
+  constexpr unsigned int kCooldown = 15;
+
+  // only start restoring quality well under budget so it doesn't flap
+  constexpr float kHeadroom = 0.75f;
+
+  constexpr float kMinDetail = 0.1f;
+}
+
+FrameBudget::FrameBudget(float budget_ms, unsigned int max_slices) :
+  budget_(budget_ms), average_(0), max_slices_(std::max(1u, max_slices)),
+  slices_(1), detail_(1.0f), cooldown_(0) {}
+
+void FrameBudget::record(float frame_ms) {
+  average_ += (frame_ms - average_) * kSmoothing;
+
+  if (budget_ <= 0) return;
+  if (cooldown_ > 0) {
+    --cooldown_;
+    return;
+  }
+
+  if (average_ > budget_) {
+    if (slices_ < max_slices_) {
+      slices_ = std::min(slices_ * 2, max_slices_);
+    } else if (detail_ > kMinDetail) {
+      detail_ = std::max(detail_ * 0.8f, kMinDetail);
+    } else {
+      return;
+    }
+  } else if (average_ < budget_ * kHeadroom) {
+    if (detail_ < 1.0f) {
+      detail_ = std::min(detail_ * 1.25f, 1.0f);
+    } else if (slices_ > 1) {
+      slices_ /= 2;
+    } else {
+      return;
+    }
+  } else {
+    return;
+  }
+
+  cooldown_ = kCooldown;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Picks how much work the simulation can afford from how long recent frames
+// took.  Over budget it first spreads flocking across more frames and then
+// cuts back on particles, and under budget it undoes that in reverse.
+class FrameBudget {
+  public:
+
+    // A budget of zero never degrades anything.
+    explicit FrameBudget(float budget_ms, unsigned int max_slices = 8);
+
+    void record(float frame_ms);
+
+    // Flocking only updates one of this many slices of the boids each frame.
+    unsigned int slices() const { return slices_; }
+
+    // The fraction of the normal number of particles to spawn.
+    float detail() const { return detail_; }
+
+  private:
+
+    float budget_, average_;
+    unsigned int max_slices_, slices_;
+    float detail_;
+    unsigned int cooldown_;
+};
@@ -0,0 +1,47 @@
+#include "command_buffer.h"
+
+#include <algorithm>
+
+bool CommandBuffer::doom(entt::entity e) {
+  const auto i = entt::to_entity(e);
+  if (doomed_.size() <= i) doomed_.resize(i + 1, false);
+  if (doomed_[i]) return false;
+
+  doomed_[i] = true;
+  return true;
+}
+
+void CommandBuffer::reserve(size_t n) {
+  commands_.reserve(n);
+  destroyed_.reserve(n);
+  recycled_.reserve(n);
+}
+
+void CommandBuffer::destroy(entt::entity e) {
+  if (doom(e)) destroyed_.push_back(e);
+}
+
+bool CommandBuffer::destroyed(entt::entity e) const {
+  const auto i = entt::to_entity(e);
+  return i < doomed_.size() && doomed_[i];
+}
+
+void CommandBuffer::flush() {
+  for (const Command& command : commands_) {
+    command.run(command.f, reg_);
+    command.destroy(command.f);
+  }
+  commands_.clear();
+  arena_.reset();
+
+  for (const auto e : recycled_) doomed_[entt::to_entity(e)] = false;
+  recycled_.clear();
+
+  // The range overload strips each component pool of the whole batch at once
+  // rather than visiting every pool once per entity.
+  for (const auto e : destroyed_) doomed_[entt::to_entity(e)] = false;
+  destroyed_.erase(std::remove_if(destroyed_.begin(), destroyed_.end(), [this](entt::entity e) { return !reg_.valid(e); }), destroyed_.end());
+  std::sort(destroyed_.begin(), destroyed_.end());
+  reg_.destroy(destroyed_.begin(), destroyed_.end());
+  destroyed_.clear();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "entt/entity/registry.hpp"
+
+#include "arena.h"
+
+// Structural changes recorded by systems while they iterate views and applied
+// together at one sync point with flush().  Destroyed entities stay valid until
+// then, so systems that care should check destroyed() first.  The same goes
+// for recycled entities, which are reset in place at flush instead.
+//
+// Commands are kept in an arena that is emptied by every flush, so recording
+// them doesn't allocate once the buffer has seen its busiest frame.
+class CommandBuffer {
+  public:
+
+    explicit CommandBuffer(entt::registry& reg) : reg_(reg) {}
+
+    // Creates an entity at flush and passes it to init to fill in.
+    template <typename F>
+    void create(F&& init) {
+      record([init = std::forward<F>(init)](entt::registry& reg) mutable { init(reg.create()); });
+    }
+
+    void destroy(entt::entity e);
+    bool destroyed(entt::entity e) const;
+
+    // Treats e as destroyed until flush, which hands it to init to be reset
+    // rather than tearing it down and creating a replacement.
+    template <typename F>
+    void recycle(entt::entity e, F&& init) {
+      if (!doom(e)) return;
+      recycled_.push_back(e);
+      record([e, init = std::forward<F>(init)](entt::registry& reg) mutable { if (reg.valid(e)) init(e); });
+    }
+
+    template <typename T, typename... Args>
+    void emplace(entt::entity e, Args&&... args) {
+      record([e, value = T{std::forward<Args>(args)...}](entt::registry& reg) {
+        if (!reg.valid(e)) return;
+        if constexpr (std::is_empty_v<T>) {
+          reg.emplace_or_replace<T>(e);
+        } else {
+          reg.emplace_or_replace<T>(e, value);
+        }
+      });
+    }
+
+    template <typename T>
+    void remove(entt::entity e) {
+      record([e](entt::registry& reg) { if (reg.valid(e)) reg.remove<T>(e); });
+    }
+
+    // Room for n commands and n entities destroyed or recycled in one frame.
+    void reserve(size_t n);
+
+    // Runs creates, recycles, emplaces and removes in the order they were
+    // recorded, then destroys everything queued in one batch.  Commands must not
+    // record more commands while they run.
+    void flush();
+
+  private:
+
+    // a recorded closure living in arena_
+    struct Command {
+      void (*run)(void* f, entt::registry& reg);
+      void (*destroy)(void* f);
+      void* f;
+    };
+
+    entt::registry& reg_;
+    Arena arena_;
+    std::vector<Command> commands_;
+    std::vector<entt::entity> destroyed_, recycled_;
+    std::vector<bool> doomed_;
+
+    // Marks e as going away this frame, returning false if it already was.
+    bool doom(entt::entity e);
+
+    template <typename F>
+    void record(F&& f) {
+      using Fn = std::decay_t<F>;
+      commands_.push_back({
+          [](void* f, entt::registry& reg) { (*static_cast<Fn*>(f))(reg); },
+          [](void* f) { static_cast<Fn*>(f)->~Fn(); },
+          arena_.make<Fn>(std::forward<F>(f)) });
+    }
+};
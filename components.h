@@ -1,5 +1,7 @@
 #pragma once
 
+#include "entt/entity/fwd.hpp"
+
 #include "geometry.h"
 
 struct Health { int health = 20; };
@@ -9,11 +11,19 @@ struct Size { float size = 0; };
 struct Velocity { float vel = 0; };
 struct Angle { float angle = 0; };
 
+// Cartesian velocity for things that don't need an angle of their own, so
+// their systems can skip the trig.
+struct Vector { pos v; };
+
+// where something was and which way it faced at the end of the last tick, for
+// drawing between ticks
+struct Previous { pos p, heading; };
+
 struct MaxVelocity { float max = 5.0f; };
 
 struct Accelleration { float accel = 0.0f; };
 struct Rotation { float rot = 0.0f; };
-struct TargetDir { float target = 0.0f; };
+struct TargetDir { pos target; };
 
 struct Color { uint32_t color = 0x006496ff; };
 
@@ -31,7 +41,6 @@ struct Timer {
   constexpr float ratio() const { return elapsed / lifetime; };
 };
 
-struct Particle {};
 struct Flash {};
 struct FadeOut {};
 
@@ -0,0 +1,45 @@
+#include "compositor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  float channel(uint32_t color, int shift) {
+    return ((color >> shift) & 0xff) / 255.0f;
+  }
+
+  uint32_t byte(float f, int shift) {
+    return (uint32_t)std::lround(std::clamp(f, 0.0f, 1.0f) * 255) << shift;
+  }
+}
+
+void Compositor::clear() {
+  r_ = g_ = b_ = a_ = 0;
+  layers_ = 0;
+}
+
+// Porter-Duff over, with everything premultiplied so layers just accumulate.
+void Compositor::add(uint32_t color) {
+  const float a = channel(color, 0);
+  if (a <= 0) return;
+
+  r_ = channel(color, 24) * a + r_ * (1 - a);
+  g_ = channel(color, 16) * a + g_ * (1 - a);
+  b_ = channel(color, 8) * a + b_ * (1 - a);
+  a_ = a + a_ * (1 - a);
+  ++layers_;
+}
+
+uint32_t Compositor::color() const {
+  if (a_ <= 0) return 0;
+  return byte(r_ / a_, 24) | byte(g_ / a_, 16) | byte(b_ / a_, 8) | byte(a_, 0);
+}
+
+uint32_t Compositor::over(uint32_t background) const {
+  const float rest = 1 - a_;
+  return
+    byte(r_ + channel(background, 24) * rest, 24) |
+    byte(g_ + channel(background, 16) * rest, 16) |
+    byte(b_ + channel(background, 8) * rest, 8) |
+    0xff;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Folds translucent full-screen layers into one color, so any number of them
+// costs a single fill.  Layers are RGBA and go over each other in the order
+// they are added, each blending over what's beneath the way a draw_rect
+// covering the screen would.
+class Compositor {
+  public:
+
+    void clear();
+    void add(uint32_t color);
+
+    size_t layers() const { return layers_; }
+
+    // One color that blends over anything the same as every layer in turn,
+    // up to eight bit rounding.  Fully transparent when there's nothing.
+    uint32_t color() const;
+
+    // The layers over an opaque background, which comes out opaque.
+    uint32_t over(uint32_t background) const;
+
+  private:
+
+    // color premultiplied by alpha, and alpha, all from 0 to 1
+    float r_ = 0, g_ = 0, b_ = 0, a_ = 0;
+    size_t layers_ = 0;
+};
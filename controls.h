@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "input.h"
+
+// The buttons the game cares about packed into bit sets, so a frame of input
+// can be copied between threads or saved.
+struct Controls {
+  uint32_t held = 0, pressed = 0;
+
+  static constexpr uint32_t bit(Input::Button b) { return 1u << static_cast<int>(b); }
+
+  static Controls read(const Input& input) {
+    static const Input::Button buttons[] = {
+      Input::Button::Up, Input::Button::Down, Input::Button::Left, Input::Button::Right,
+      Input::Button::A, Input::Button::B, Input::Button::Select, Input::Button::Start,
+    };
+
+    Controls controls;
+    for (const auto b : buttons) {
+      if (input.key_held(b)) controls.held |= bit(b);
+      if (input.key_pressed(b)) controls.pressed |= bit(b);
+    }
+    return controls;
+  }
+
+  bool key_held(Input::Button b) const { return held & bit(b); }
+  bool key_pressed(Input::Button b) const { return pressed & bit(b); }
+};
@@ -0,0 +1,133 @@
+#include "counters.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* Counters::name(size_t event) {
+  static const char* const names[kEvents] = { "cycles", "instructions", "l1_misses", "llc_misses", "branch_misses" };
+  return event < kEvents ? names[event] : "";
+}
+
+#if defined(__linux__)
+
+namespace {
+  struct Config {
+    uint32_t type;
+    uint64_t config;
+  };
+
+  // L1 misses are data reads only, which is what the systems' loads are.
+  const Config kConfigs[Counters::kEvents] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+
+  // All of one thread's counters in a single group with cycles leading, so
+  // they run over exactly the same stretches and come back in one read.
+  class Group {
+    public:
+
+      Group() {
+        for (size_t e = 0; e < Counters::kEvents; ++e) {
+          fd_[e] = open(kConfigs[e], e == 0 ? -1 : fd_[0]);
+          if (fd_[e] < 0) {
+            if (e == 0) {
+              error_ = errno;
+              return;
+            }
+            continue;
+          }
+          slot_[e] = members_++;
+        }
+      }
+
+      ~Group() {
+        for (const int fd : fd_) {
+          if (fd >= 0) close(fd);
+        }
+      }
+
+      Group(const Group&) = delete;
+      Group& operator=(const Group&) = delete;
+
+      bool ok() const { return fd_[0] >= 0; }
+      int error() const { return error_; }
+      bool counted(size_t event) const { return slot_[event] >= 0; }
+
+      Counters::Sample read() const {
+        Counters::Sample sample {};
+        if (!ok()) return sample;
+
+        // nr, time enabled, time running, then one value per member
+        uint64_t values[3 + Counters::kEvents];
+        const ssize_t want = (3 + members_) * sizeof(uint64_t);
+        if (::read(fd_[0], values, sizeof(values)) < want || values[2] == 0) return sample;
+
+        const double scale = (double)values[1] / values[2];
+        for (size_t e = 0; e < Counters::kEvents; ++e) {
+          if (slot_[e] >= 0) sample[e] = (uint64_t)(values[3 + slot_[e]] * scale);
+        }
+        return sample;
+      }
+
+    private:
+
+      int fd_[Counters::kEvents] = { -1, -1, -1, -1, -1 };
+      int slot_[Counters::kEvents] = { -1, -1, -1, -1, -1 };
+      int members_ = 0;
+      int error_ = 0;
+
+      static int open(const Config& config, int leader) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = config.type;
+        attr.config = config.config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // this thread, on whichever CPU it runs
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+      }
+  };
+
+  const Group& group() {
+    thread_local const Group group;
+    return group;
+  }
+}
+
+bool Counters::available() {
+  return group().ok();
+}
+
+const char* Counters::error() {
+  return group().ok() ? "" : std::strerror(group().error());
+}
+
+bool Counters::counted(size_t event) {
+  return event < kEvents && group().counted(event);
+}
+
+Counters::Sample Counters::read() {
+  return group().read();
+}
+
+#else
+
+bool Counters::available() { return false; }
+const char* Counters::error() { return "perf_event_open is Linux only"; }
+bool Counters::counted(size_t) { return false; }
+Counters::Sample Counters::read() { return {}; }
+
+#endif
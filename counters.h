@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware performance counters for the calling thread, read through Linux's
+// perf_event_open.  Each thread opens its own group the first time it reads.
+// Where that fails (another OS, no PMU in a VM, perf_event_paranoid too high)
+// available() is false and every read gives zeros, so callers never need to
+// check.  Events the CPU doesn't have are left out the same way.
+class Counters {
+  public:
+
+    enum Event { cycles, instructions, l1_misses, llc_misses, branch_misses, kEvents };
+
+    using Sample = std::array<uint64_t, kEvents>;
+
+    static const char* name(size_t event);
+
+    // Whether the calling thread could open at least the cycle counter, and
+    // why not when it couldn't.
+    static bool available();
+    static const char* error();
+
+    // Whether an event opened, once available() is true.
+    static bool counted(size_t event);
+
+    // Running totals for the calling thread, scaled up for any time the
+    // kernel had to multiplex them off the hardware.
+    static Sample read();
+};
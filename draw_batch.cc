@@ -0,0 +1,190 @@
+#include "draw_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+void DrawBatch::reserve(size_t n) {
+  commands_.reserve(n);
+  vertices_.reserve(4 * n);
+  indices_.reserve(6 * n);
+}
+
+void DrawBatch::draw_pixel(const Point& p, uint32_t color) {
+  commands_.push_back({ Kind::pixel, true, 0, p, p, color });
+  covered_ += 1;
+}
+
+void DrawBatch::draw_line(const Point& p1, const Point& p2, uint32_t color) {
+  commands_.push_back({ Kind::line, true, 0, p1, p2, color });
+  covered_ += std::max(std::abs((int64_t)p2.x - p1.x), std::abs((int64_t)p2.y - p1.y)) + 1;
+}
+
+void DrawBatch::draw_rect(const Point& p1, const Point& p2, uint32_t color, bool filled) {
+  commands_.push_back({ Kind::rect, filled, 0, p1, p2, color });
+  const size_t w = std::abs((int64_t)p2.x - p1.x), h = std::abs((int64_t)p2.y - p1.y);
+  covered_ += filled || w < 2 || h < 2 ? w * h : 2 * (w + h) - 4;
+}
+
+// Circles are counted as their ideal areas, which is close enough.
+void DrawBatch::draw_circle(const Point& center, int radius, uint32_t color, bool filled) {
+  commands_.push_back({ Kind::circle, filled, radius, center, center, color });
+  covered_ += (size_t)(filled ? M_PI * radius * radius : 2 * M_PI * radius) + 1;
+}
+
+namespace {
+  constexpr SDL_Color sdl_color(uint32_t color) {
+    return { (Uint8)(color >> 24), (Uint8)(color >> 16), (Uint8)(color >> 8), (Uint8)color };
+  }
+
+  constexpr int kCircleSegments = 12;
+
+  struct Circle {
+    float x[kCircleSegments + 1], y[kCircleSegments + 1];
+
+    Circle() {
+      for (int i = 0; i <= kCircleSegments; ++i) {
+        x[i] = std::cos(2 * M_PI * i / kCircleSegments);
+        y[i] = std::sin(2 * M_PI * i / kCircleSegments);
+      }
+    }
+  };
+
+  const Circle kUnitCircle;
+}
+
+void DrawBatch::flush(Graphics& graphics) {
+  primitives_ = commands_.size();
+  pixels_ = covered_;
+  covered_ = 0;
+  draw_calls_ = 0;
+  if (commands_.empty()) return;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  if (SDL_Renderer* renderer = find_renderer()) {
+    vertices_.clear();
+    indices_.clear();
+    for (const auto& c : commands_) tessellate(c);
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometry(renderer, nullptr, vertices_.data(), vertices_.size(), indices_.data(), indices_.size());
+    draw_calls_ = 1;
+
+    commands_.clear();
+    return;
+  }
+#endif
+
+  replay(graphics);
+  draw_calls_ = commands_.size();
+  commands_.clear();
+}
+
+// libgam keeps its window and renderer to itself, so both are looked up
+// again every flush: the window the renderer came from last time if it's
+// still open, otherwise the one with the GL context, keyboard or mouse.
+// Whichever window that is, its current renderer is the one used.
+SDL_Renderer* DrawBatch::find_renderer() {
+  SDL_Window* window = window_ ? SDL_GetWindowFromID(window_) : nullptr;
+  if (!window) window = SDL_GL_GetCurrentWindow();
+  if (!window) window = SDL_GetKeyboardFocus();
+  if (!window) window = SDL_GetMouseFocus();
+
+  SDL_Renderer* renderer = window ? SDL_GetRenderer(window) : nullptr;
+  window_ = renderer ? SDL_GetWindowID(window) : 0;
+  return renderer;
+}
+
+void DrawBatch::flush(Framebuffer& framebuffer) {
+  primitives_ = commands_.size();
+  pixels_ = covered_;
+  covered_ = 0;
+  draw_calls_ = 0;
+  replay(framebuffer);
+  commands_.clear();
+}
+
+void DrawBatch::quad(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, SDL_Color color) {
+  const int n = vertices_.size();
+  vertices_.push_back({ { x1, y1 }, color, { 0, 0 } });
+  vertices_.push_back({ { x2, y2 }, color, { 0, 0 } });
+  vertices_.push_back({ { x3, y3 }, color, { 0, 0 } });
+  vertices_.push_back({ { x4, y4 }, color, { 0, 0 } });
+
+  for (const int i : { 0, 1, 2, 0, 2, 3 }) indices_.push_back(n + i);
+}
+
+void DrawBatch::box(float left, float top, float right, float bottom, SDL_Color color) {
+  quad(left, top, right, top, right, bottom, left, bottom, color);
+}
+
+void DrawBatch::tessellate(const Command& c) {
+  const SDL_Color color = sdl_color(c.color);
+  const float x1 = c.p1.x, y1 = c.p1.y, x2 = c.p2.x, y2 = c.p2.y;
+
+  switch (c.kind) {
+    case Kind::pixel:
+      box(x1, y1, x1 + 1, y1 + 1, color);
+      break;
+
+    case Kind::rect:
+      if (c.filled) {
+        box(x1, y1, x2, y2, color);
+      } else {
+        box(x1, y1, x2, y1 + 1, color);
+        box(x1, y2 - 1, x2, y2, color);
+        box(x1, y1 + 1, x1 + 1, y2 - 1, color);
+        box(x2 - 1, y1 + 1, x2, y2 - 1, color);
+      }
+      break;
+
+    case Kind::line:
+      {
+        // a one pixel wide quad running through the pixel centers
+        const float dx = x2 - x1, dy = y2 - y1;
+        const float len = std::sqrt(dx * dx + dy * dy);
+        const float ux = len > 0 ? dx / len / 2 : 0.5f, uy = len > 0 ? dy / len / 2 : 0.0f;
+        const float ax = x1 + 0.5f - ux, ay = y1 + 0.5f - uy;
+        const float bx = x2 + 0.5f + ux, by = y2 + 0.5f + uy;
+        quad(ax - uy, ay + ux, bx - uy, by + ux, bx + uy, by - ux, ax + uy, ay - ux, color);
+      }
+      break;
+
+    case Kind::circle:
+      {
+        const float cx = x1 + 0.5f, cy = y1 + 0.5f;
+        const float outer = c.radius + 0.5f, inner = c.filled ? 0.0f : c.radius - 0.5f;
+
+        const Circle& u = kUnitCircle;
+        for (int i = 0; i < kCircleSegments; ++i) {
+          quad(
+              cx + inner * u.x[i], cy + inner * u.y[i],
+              cx + outer * u.x[i], cy + outer * u.y[i],
+              cx + outer * u.x[i + 1], cy + outer * u.y[i + 1],
+              cx + inner * u.x[i + 1], cy + inner * u.y[i + 1],
+              color);
+        }
+      }
+      break;
+  }
+}
+
+template <typename Target>
+void DrawBatch::replay(Target& target) {
+  for (const auto& c : commands_) {
+    switch (c.kind) {
+      case Kind::pixel:
+        target.draw_pixel(c.p1, c.color);
+        break;
+      case Kind::line:
+        target.draw_line(c.p1, c.p2, c.color);
+        break;
+      case Kind::rect:
+        target.draw_rect(c.p1, c.p2, c.color, c.filled);
+        break;
+      case Kind::circle:
+        target.draw_circle(c.p1, c.radius, c.color, c.filled);
+        break;
+    }
+  }
+}
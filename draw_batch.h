@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+#include "graphics.h"
+
+#include "framebuffer.h"
+
+// Collects primitives with the same calls as Graphics and submits them all at
+// once.  Submission order is kept so overlapping primitives still layer the
+// way the equivalent sequence of Graphics calls would.
+class DrawBatch {
+  public:
+
+    using Point = Graphics::Point;
+
+    void draw_pixel(const Point& p, uint32_t color);
+    void draw_line(const Point& p1, const Point& p2, uint32_t color);
+    void draw_rect(const Point& p1, const Point& p2, uint32_t color, bool filled);
+    void draw_circle(const Point& center, int radius, uint32_t color, bool filled);
+
+    // Draws everything collected so far and empties the batch.  Uses a single
+    // geometry call on the SDL renderer when one can be found, looking again
+    // every time in case the window changed, and falls back to one Graphics
+    // call per primitive otherwise.
+    void flush(Graphics& graphics);
+
+    // Draws everything into a software framebuffer instead, in order.
+    void flush(Framebuffer& framebuffer);
+
+    // Room for n primitives, and roughly for tessellating them.
+    void reserve(size_t n);
+
+    size_t size() const { return commands_.size(); }
+
+    // Counts from the most recent flush.
+    size_t primitives() const { return primitives_; }
+    size_t draw_calls() const { return draw_calls_; }
+
+    // Pixels covered, counting each time one is drawn over, which is what
+    // fill rate is spent on.
+    size_t pixels() const { return pixels_; }
+
+  private:
+
+    enum class Kind : uint8_t { pixel, line, rect, circle };
+
+    struct Command {
+      Kind kind;
+      bool filled;
+      int radius;
+      Point p1, p2;
+      uint32_t color;
+    };
+
+    std::vector<Command> commands_;
+    size_t primitives_ = 0, draw_calls_ = 0;
+    size_t covered_ = 0, pixels_ = 0;
+
+    // the window the renderer was found through last flush, 0 for none
+    Uint32 window_ = 0;
+
+    // scratch space for tessellating commands, kept to avoid reallocating
+    std::vector<SDL_Vertex> vertices_;
+    std::vector<int> indices_;
+
+    SDL_Renderer* find_renderer();
+
+    void quad(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, SDL_Color color);
+    void box(float left, float top, float right, float bottom, SDL_Color color);
+    void tessellate(const Command& c);
+
+    // one call per primitive, on anything with the same calls as Graphics
+    template <typename Target> void replay(Target& target);
+};
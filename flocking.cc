@@ -0,0 +1,311 @@
+#include "flocking.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  // how many approximation cells fit across the sight radius
+  constexpr float kFineCells = 4.0f;
+
+  // Below this many boids in the neighborhood visiting every cell costs more
+  // than checking every boid.
+  constexpr size_t kApproximateAbove = 2048;
+}
+
+Flock::Flock(float sight, float crowding, float width, float height, float theta) :
+  sight_(sight), crowding_(crowding), theta_(theta),
+  cell_(theta > 0 ? sight / kFineCells : sight),
+  columns_((int)std::ceil(width / cell_) + 1),
+  rows_((int)std::ceil(height / cell_) + 1),
+  start_(columns_ * rows_ + 1) {}
+
+void Flock::clear() {
+  px_.clear();
+  py_.clear();
+  vx_.clear();
+  vy_.clear();
+  cell_of_.clear();
+}
+
+void Flock::add(const pos p, const pos v) {
+  px_.push_back(p.x);
+  py_.push_back(p.y);
+  vx_.push_back(v.x);
+  vy_.push_back(v.y);
+  cell_of_.push_back(row(p.y) * columns_ + column(p.x));
+}
+
+// Counting sort: size each cell, turn the sizes into offsets, then drop every
+// boid into the next free spot of its cell.
+void Flock::build() {
+  const size_t n = size();
+
+  std::fill(start_.begin(), start_.end(), 0);
+  for (const uint32_t c : cell_of_) ++start_[c + 1];
+  for (size_t c = 1; c < start_.size(); ++c) start_[c] += start_[c - 1];
+
+  x_.resize(n);
+  y_.resize(n);
+  u_.resize(n);
+  w_.resize(n);
+
+  next_.assign(start_.begin(), start_.end() - 1);
+  for (size_t i = 0; i < n; ++i) {
+    const uint32_t s = next_[cell_of_[i]]++;
+    x_[s] = px_[i];
+    y_[s] = py_[i];
+    u_[s] = vx_[i];
+    w_[s] = vy_[i];
+  }
+
+  if (theta_ <= 0) return;
+
+  const size_t cells = start_.size() - 1;
+  center_x_.assign(cells, 0.0f);
+  center_y_.assign(cells, 0.0f);
+  sum_u_.assign(cells, 0.0f);
+  sum_w_.assign(cells, 0.0f);
+  for (size_t c = 0; c < cells; ++c) {
+    if (start_[c] == start_[c + 1]) continue;
+
+    for (size_t i = start_[c]; i < start_[c + 1]; ++i) {
+      center_x_[c] += x_[i];
+      center_y_[c] += y_[i];
+      sum_u_[c] += u_[i];
+      sum_w_[c] += w_[i];
+    }
+
+    const float n = (float)(start_[c + 1] - start_[c]);
+    center_x_[c] /= n;
+    center_y_[c] /= n;
+  }
+}
+
+namespace {
+#if defined(__AVX2__)
+  using lanes = __m256;
+  constexpr size_t kWidth = 8;
+  lanes zero() { return _mm256_setzero_ps(); }
+  lanes set(float f) { return _mm256_set1_ps(f); }
+  lanes load(const float* p) { return _mm256_loadu_ps(p); }
+  lanes add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+  lanes sub(lanes a, lanes b) { return _mm256_sub_ps(a, b); }
+  lanes mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+  lanes mask(lanes m, lanes a) { return _mm256_and_ps(m, a); }
+  lanes lt(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  float total(lanes v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+#elif defined(__SSE2__)
+  using lanes = __m128;
+  constexpr size_t kWidth = 4;
+  lanes zero() { return _mm_setzero_ps(); }
+  lanes set(float f) { return _mm_set1_ps(f); }
+  lanes load(const float* p) { return _mm_loadu_ps(p); }
+  lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+  lanes sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+  lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+  lanes mask(lanes m, lanes a) { return _mm_and_ps(m, a); }
+  lanes lt(lanes a, lanes b) { return _mm_cmplt_ps(a, b); }
+  float total(lanes s) {
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+#endif
+
+  // Running sums for one boid.  Vector lanes are only added together at the
+  // end so summing many short runs stays cheap.
+  class Accumulator {
+    public:
+
+      Accumulator(float bx, float by, float sight2, float crowd2) :
+        bx_(bx), by_(by), sight2_(sight2), crowd2_(crowd2) {}
+
+      // Adds the boids in [begin, end) that are within sight.  The boid itself
+      // is included like any other and taken back out by finish().
+      void run(const float* x, const float* y, const float* u, const float* w, size_t begin, size_t end) {
+        size_t i = begin;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+        const lanes bx = set(bx_), by = set(by_);
+        const lanes s2 = set(sight2_), c2 = set(crowd2_);
+        const lanes one = set(1.0f);
+
+        for (; i + kWidth <= end; i += kWidth) {
+          const lanes dx = sub(load(x + i), bx);
+          const lanes dy = sub(load(y + i), by);
+          const lanes d2 = add(mul(dx, dx), mul(dy, dy));
+          const lanes seen = lt(d2, s2);
+          const lanes close = lt(d2, c2);
+
+          count_ = add(count_, mask(seen, one));
+          cx_ = add(cx_, mask(seen, dx));
+          cy_ = add(cy_, mask(seen, dy));
+          fx_ = add(fx_, mask(seen, load(u + i)));
+          fy_ = add(fy_, mask(seen, load(w + i)));
+          ax_ = sub(ax_, mask(close, dx));
+          ay_ = sub(ay_, mask(close, dy));
+        }
+#endif
+
+        for (; i < end; ++i) {
+          const float dx = x[i] - bx_;
+          const float dy = y[i] - by_;
+          const float d2 = dx * dx + dy * dy;
+
+          if (d2 < sight2_) {
+            s_.count += 1;
+            s_.center += { dx, dy };
+            s_.flock += { u[i], w[i] };
+          }
+
+          if (d2 < crowd2_) s_.avoid -= { dx, dy };
+        }
+      }
+
+      // Adds n boids at once, centered on center and moving with velocities
+      // summing to v.
+      void group(float n, const pos center, const pos v) {
+        s_.count += n;
+        s_.center += (center - pos{ bx_, by_ }) * n;
+        s_.flock += v;
+      }
+
+      // The boid saw itself at distance zero, which only counted toward count
+      // and flock.
+      Flock::Sums finish(const pos v) const {
+        Flock::Sums s;
+        float count = s_.count;
+        s.center = s_.center;
+        s.flock = s_.flock - v;
+        s.avoid = s_.avoid;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+        count += total(count_);
+        s.center += { total(cx_), total(cy_) };
+        s.flock += { total(fx_), total(fy_) };
+        s.avoid += { total(ax_), total(ay_) };
+#endif
+
+        s.count = (int)count - 1;
+        return s;
+      }
+
+    private:
+
+      struct Scalar {
+        float count = 0;
+        pos center, flock, avoid;
+      };
+
+      float bx_, by_, sight2_, crowd2_;
+      Scalar s_;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+      lanes count_ = zero(), cx_ = zero(), cy_ = zero(), fx_ = zero(), fy_ = zero(), ax_ = zero(), ay_ = zero();
+#endif
+  };
+}
+
+Flock::Sums Flock::sums(size_t boid) const {
+  if (theta_ <= 0) return exact(boid);
+
+  const float bx = px_[boid], by = py_[boid];
+  const int c1 = column(bx - sight_), c2 = column(bx + sight_);
+  const int r1 = row(by - sight_), r2 = row(by + sight_);
+
+  size_t nearby = 0;
+  for (int r = r1; r <= r2; ++r) nearby += start_[r * columns_ + c2 + 1] - start_[r * columns_ + c1];
+  return nearby > kApproximateAbove ? approximate(boid) : exact(boid);
+}
+
+Flock::Sums Flock::exact(size_t boid) const {
+  const float bx = px_[boid], by = py_[boid];
+  const int c1 = column(bx - sight_), c2 = column(bx + sight_);
+  const int r1 = row(by - sight_), r2 = row(by + sight_);
+
+  // Cells in a row are next to each other, so each row of the neighborhood
+  // is one run.
+  Accumulator acc(bx, by, sight_ * sight_, crowding_ * crowding_);
+  for (int r = r1; r <= r2; ++r) {
+    acc.run(x_.data(), y_.data(), u_.data(), w_.data(), start_[r * columns_ + c1], start_[r * columns_ + c2 + 1]);
+  }
+
+  return acc.finish({ vx_[boid], vy_[boid] });
+}
+
+Flock::Sums Flock::approximate(size_t boid) const {
+  const float bx = px_[boid], by = py_[boid];
+  const int c1 = column(bx - sight_), c2 = column(bx + sight_);
+  const int r1 = row(by - sight_), r2 = row(by + sight_);
+  const float sight2 = sight_ * sight_, crowd2 = crowding_ * crowding_;
+  const float theta2 = theta_ * theta_;
+
+  Accumulator acc(bx, by, sight2, crowd2);
+
+  // Neighboring cells summed boid by boid are merged into runs.
+  size_t run_begin = 0, run_end = 0;
+  const auto flush = [&] {
+    acc.run(x_.data(), y_.data(), u_.data(), w_.data(), run_begin, run_end);
+    run_begin = run_end = 0;
+  };
+
+  for (int r = r1; r <= r2; ++r) {
+    for (int c = c1; c <= c2; ++c) {
+      const size_t cell = r * columns_ + c;
+      const size_t begin = start_[cell], end = start_[cell + 1];
+      if (begin == end) continue;
+
+      // nearest and farthest the cell's square gets to the boid
+      const float left = c * cell_, top = r * cell_;
+      const float nx = std::clamp(bx, left, left + cell_) - bx;
+      const float ny = std::clamp(by, top, top + cell_) - by;
+      const float fx = std::max(std::abs(left - bx), std::abs(left + cell_ - bx));
+      const float fy = std::max(std::abs(top - by), std::abs(top + cell_ - by));
+      const float near2 = nx * nx + ny * ny;
+      const float far2 = fx * fx + fy * fy;
+
+      // Border cells also hold everything past the edge of the world so
+      // their squares say nothing about where their boids are.
+      const bool border = c == 0 || r == 0 || c == columns_ - 1 || r == rows_ - 1;
+
+      if (!border && near2 >= sight2) continue;
+
+      if (!border && near2 >= crowd2) {
+        const pos center { center_x_[cell], center_y_[cell] };
+        const float d2 = center.dist2({ bx, by });
+
+        // entirely in sight, or far enough away to treat as a point
+        if (far2 < sight2 || cell_ * cell_ < theta2 * d2) {
+          if (far2 < sight2 || d2 < sight2) acc.group(end - begin, center, { sum_u_[cell], sum_w_[cell] });
+          continue;
+        }
+      }
+
+      if (begin != run_end) {
+        flush();
+        run_begin = begin;
+      }
+      run_end = end;
+    }
+  }
+  flush();
+
+  return acc.finish({ vx_[boid], vy_[boid] });
+}
+
+int Flock::column(float x) const {
+  return std::clamp((int)std::floor(x / cell_), 0, columns_ - 1);
+}
+
+int Flock::row(float y) const {
+  return std::clamp((int)std::floor(y / cell_), 0, rows_ - 1);
+}
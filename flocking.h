@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+// Neighbor sums for boids, computed from a grid whose cells are packed one
+// after another into parallel float arrays.  Every cell a boid can see is a
+// contiguous run, so the inner loop is straight loads and masked adds done
+// with AVX2 or SSE2 when built for them.
+//
+// With a theta above zero the sums are approximated Barnes-Hut style on a
+// finer grid: a cell whose size over its distance from the boid is below
+// theta counts as all of its boids sitting at their center of mass.  Cells
+// that could hold anything too close are always summed boid by boid so
+// separation stays exact.  Bigger thetas are faster and less accurate.
+class Flock {
+  public:
+
+    // What a boid sees.  center is relative to the boid itself.
+    struct Sums {
+      int count = 0;
+      pos center, flock, avoid;
+    };
+
+    Flock(float sight, float crowding, float width, float height, float theta = 0.0f);
+
+    // Boids are numbered in the order they are added.
+    void clear();
+    void add(const pos p, const pos v);
+    size_t size() const { return px_.size(); }
+
+    // Packs everything added since clear() into cells.  Must be called before
+    // sums() and after the last add().
+    void build();
+
+    // Sums over every other boid within sight, and those too close.  Safe to
+    // call for different boids from several threads at once.
+    Sums sums(size_t boid) const;
+
+  private:
+
+    float sight_, crowding_, theta_, cell_;
+    int columns_, rows_;
+
+    // boids as added, with their cells
+    std::vector<float> px_, py_, vx_, vy_;
+    std::vector<uint32_t> cell_of_;
+
+    // boids sorted by cell, where cell c is [start_[c], start_[c + 1])
+    std::vector<uint32_t> start_, next_;
+    std::vector<float> x_, y_, u_, w_;
+
+    // per cell centers of mass and velocity totals, when approximating
+    std::vector<float> center_x_, center_y_, sum_u_, sum_w_;
+
+    Sums exact(size_t boid) const;
+    Sums approximate(size_t boid) const;
+
+    int column(float x) const;
+    int row(float y) const;
+};
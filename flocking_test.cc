@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "flocking.h"
+
+// Checks Flock's sums against checking every pair of boids in double, the
+// way the game did before there was a grid, once exact and once with the
+// approximation at a theta dense enough to use it.
+
+namespace {
+  constexpr float kSight = 75.0f, kCrowding = 20.0f;
+  constexpr float kWidth = 1280.0f, kHeight = 720.0f;
+
+  struct dpos { double x = 0, y = 0; };
+
+  struct Expected {
+    int count = 0;
+    dpos center, flock, avoid;
+    double center_scale = 0, flock_scale = 0, avoid_scale = 0;
+    bool edge = false;
+  };
+
+  double mag(double x, double y) { return std::sqrt(x * x + y * y); }
+
+  // Relative to the total size of the terms that were summed, since sums that
+  // mostly cancel out can't be expected to keep their relative precision.
+  double error(const dpos expected, const pos actual, double scale) {
+    return mag(expected.x - actual.x, expected.y - actual.y) / std::max(1.0, scale);
+  }
+
+  Expected brute_force(const std::vector<pos>& ps, const std::vector<pos>& vs, size_t boid) {
+    Expected e;
+    const pos b = ps[boid];
+    for (size_t i = 0; i < ps.size(); ++i) {
+      if (i == boid) continue;
+
+      const double dx = (double)ps[i].x - b.x, dy = (double)ps[i].y - b.y;
+      const double d = dx * dx + dy * dy;
+
+      // Neighbors right on the edge of either radius can land either side
+      // of it depending on rounding, so such boids aren't held to exact sums.
+      for (const double r : { kSight, kCrowding }) {
+        if (std::abs(d - r * r) <= 1e-4 * r * r) e.edge = true;
+      }
+
+      if (d < kSight * kSight) {
+        ++e.count;
+        e.center.x += dx;
+        e.center.y += dy;
+        e.flock.x += vs[i].x;
+        e.flock.y += vs[i].y;
+        e.center_scale += mag(dx, dy);
+        e.flock_scale += mag(vs[i].x, vs[i].y);
+      }
+      if (d < kCrowding * kCrowding) {
+        e.avoid.x -= dx;
+        e.avoid.y -= dy;
+        e.avoid_scale += mag(dx, dy);
+      }
+    }
+    return e;
+  }
+
+  // Boids bunched around a few centers, the way flocks gather in play.
+  void scatter(unsigned int seed, size_t n, size_t clusters, float spread, std::vector<pos>& ps, std::vector<pos>& vs) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> px(0, kWidth), py(0, kHeight), v(-5, 5);
+    std::normal_distribution<float> around(0, spread);
+
+    std::vector<pos> centers(clusters);
+    for (pos& c : centers) c = { px(rng), py(rng) };
+
+    ps.resize(n);
+    vs.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      const pos c = centers[i % clusters];
+      ps[i] = { std::clamp(c.x + around(rng), 0.0f, kWidth), std::clamp(c.y + around(rng), 0.0f, kHeight) };
+      vs[i] = { v(rng), v(rng) };
+    }
+  }
+
+  // Every boid against the brute force sums.  Exact mode has to agree on
+  // every count and to rounding on every sum.  The approximation takes whole
+  // cells at a time, so it has to keep separation exact and get counts and
+  // the steering flocking() makes from the sums within tolerance on average.
+  bool check(const char* name, unsigned int seed, size_t n, size_t clusters, float spread, float theta, double tolerance) {
+    std::vector<pos> ps, vs;
+    scatter(seed, n, clusters, spread, ps, vs);
+
+    Flock flock(kSight, kCrowding, kWidth, kHeight, theta);
+    for (size_t i = 0; i < n; ++i) flock.add(ps[i], vs[i]);
+    flock.build();
+
+    bool ok = true;
+    double worst = 0, steering = 0, steering_error = 0;
+    size_t steered = 0, seen = 0, miscounted = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+      const Expected e = brute_force(ps, vs, i);
+      const Flock::Sums s = flock.sums(i);
+      if (e.edge) continue;
+
+      seen += e.count;
+      miscounted += std::abs(s.count - e.count);
+      if (theta <= 0 && s.count != e.count) {
+        std::fprintf(stderr, "%s: boid %zu sees %d, expected %d\n", name, i, s.count, e.count);
+        ok = false;
+        continue;
+      }
+
+      worst = std::max(worst, error(e.avoid, s.avoid, e.avoid_scale));
+      if (theta <= 0) {
+        worst = std::max(worst, error(e.center, s.center, e.center_scale));
+        worst = std::max(worst, error(e.flock, s.flock, e.flock_scale));
+      }
+      if (e.count == 0 || s.count == 0) continue;
+
+      const dpos expected {
+        e.center.x / e.count * 0.005 + e.avoid.x * 0.05 + e.flock.x / e.count * 0.05,
+        e.center.y / e.count * 0.005 + e.avoid.y * 0.05 + e.flock.y / e.count * 0.05 };
+      const pos actual = s.center / s.count * 0.005f + s.avoid * 0.05f + s.flock / s.count * 0.05f;
+      steering += mag(expected.x, expected.y);
+      steering_error += mag(expected.x - actual.x, expected.y - actual.y);
+      ++steered;
+    }
+
+    const double relative = steered > 0 ? steering_error / steering : 0;
+    const double counts = seen > 0 ? (double)miscounted / seen : 0;
+    std::printf("%s: %zu boids, worst sum error %g, count error %.4f%%, steering error %.4f%%\n",
+        name, n, worst, 100 * counts, 100 * relative);
+
+    if (!(worst < 1e-3)) {
+      std::fprintf(stderr, "%s: sums off by %g\n", name, worst);
+      ok = false;
+    }
+    if (!(counts <= tolerance)) {
+      std::fprintf(stderr, "%s: counts off by %g, over %g\n", name, counts, tolerance);
+      ok = false;
+    }
+    if (!(relative <= tolerance)) {
+      std::fprintf(stderr, "%s: steering off by %g, over %g\n", name, relative, tolerance);
+      ok = false;
+    }
+    return ok;
+  }
+}
+
+int main() {
+  bool ok = true;
+  ok &= check("exact", 1, 3000, 16, 40.0f, 0.0f, 1e-5);
+  ok &= check("exact sparse", 2, 500, 500, 200.0f, 0.0f, 1e-5);
+
+  // tight enough that neighborhoods are big enough to approximate
+  ok &= check("theta 0.5", 3, 12000, 3, 30.0f, 0.5f, 0.02);
+  ok &= check("theta 1", 4, 12000, 3, 30.0f, 1.0f, 0.05);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  // A color ready to blend: every channel of the source already multiplied by
+  // its alpha, with 128 added for rounding, and what's left for the
+  // destination.  t / 255 rounded is (t + (t >> 8)) >> 8 for any t up to
+  // 255 * 255 + 128, which keeps every step inside 16 bits.
+  struct Paint {
+    uint32_t rgb, alpha;
+    uint16_t b, g, r, inverse;
+
+    explicit Paint(uint32_t color) :
+      rgb(color >> 8), alpha(color & 0xff),
+      b((uint16_t)(((color >> 8) & 0xff) * alpha + 128)),
+      g((uint16_t)(((color >> 16) & 0xff) * alpha + 128)),
+      r((uint16_t)(((color >> 24) & 0xff) * alpha + 128)),
+      inverse((uint16_t)(255 - alpha)) {}
+  };
+
+  uint32_t channel(uint32_t src, uint32_t dst, uint32_t inverse) {
+    const uint32_t t = src + dst * inverse;
+    return (t + (t >> 8)) >> 8;
+  }
+
+  uint32_t blend(uint32_t dst, const Paint& paint) {
+    return
+      channel(paint.r, (dst >> 16) & 0xff, paint.inverse) << 16 |
+      channel(paint.g, (dst >> 8) & 0xff, paint.inverse) << 8 |
+      channel(paint.b, dst & 0xff, paint.inverse);
+  }
+
+#if defined(__AVX2__)
+  using lanes = __m256i;
+  constexpr int kWidth = 8;
+  lanes set(uint32_t i) { return _mm256_set1_epi32((int)i); }
+  lanes set_channels(const Paint& p) { return _mm256_set1_epi64x((int64_t)((uint64_t)128 << 48 | (uint64_t)p.r << 32 | (uint64_t)p.g << 16 | p.b)); }
+  lanes set16(uint16_t i) { return _mm256_set1_epi16((short)i); }
+  lanes load(const uint32_t* p) { return _mm256_loadu_si256((const lanes*)p); }
+  void store(uint32_t* p, lanes a) { _mm256_storeu_si256((lanes*)p, a); }
+  lanes zero() { return _mm256_setzero_si256(); }
+  lanes widen_lo(lanes a) { return _mm256_unpacklo_epi8(a, zero()); }
+  lanes widen_hi(lanes a) { return _mm256_unpackhi_epi8(a, zero()); }
+  lanes narrow(lanes lo, lanes hi) { return _mm256_packus_epi16(lo, hi); }
+  lanes add16(lanes a, lanes b) { return _mm256_add_epi16(a, b); }
+  lanes mul16(lanes a, lanes b) { return _mm256_mullo_epi16(a, b); }
+  lanes shift8(lanes a) { return _mm256_srli_epi16(a, 8); }
+#elif defined(__SSE2__)
+  using lanes = __m128i;
+  constexpr int kWidth = 4;
+  lanes set(uint32_t i) { return _mm_set1_epi32((int)i); }
+  lanes set_channels(const Paint& p) { return _mm_set1_epi64x((int64_t)((uint64_t)128 << 48 | (uint64_t)p.r << 32 | (uint64_t)p.g << 16 | p.b)); }
+  lanes set16(uint16_t i) { return _mm_set1_epi16((short)i); }
+  lanes load(const uint32_t* p) { return _mm_loadu_si128((const lanes*)p); }
+  void store(uint32_t* p, lanes a) { _mm_storeu_si128((lanes*)p, a); }
+  lanes zero() { return _mm_setzero_si128(); }
+  lanes widen_lo(lanes a) { return _mm_unpacklo_epi8(a, zero()); }
+  lanes widen_hi(lanes a) { return _mm_unpackhi_epi8(a, zero()); }
+  lanes narrow(lanes lo, lanes hi) { return _mm_packus_epi16(lo, hi); }
+  lanes add16(lanes a, lanes b) { return _mm_add_epi16(a, b); }
+  lanes mul16(lanes a, lanes b) { return _mm_mullo_epi16(a, b); }
+  lanes shift8(lanes a) { return _mm_srli_epi16(a, 8); }
+#endif
+
+  // Covers n pixels starting at p.  The unused top byte blends as zero over
+  // zero with 128 for rounding, which stays zero.
+  void fill(uint32_t* p, int n, const Paint& paint) {
+    if (paint.alpha == 0) return;
+
+    int i = 0;
+    if (paint.alpha == 255) {
+#if defined(__AVX2__) || defined(__SSE2__)
+      const lanes c = set(paint.rgb);
+      for (; i + kWidth <= n; i += kWidth) store(p + i, c);
+#endif
+      for (; i < n; ++i) p[i] = paint.rgb;
+      return;
+    }
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    const lanes src = set_channels(paint), inverse = set16(paint.inverse);
+    const auto mix = [&](lanes dst) {
+      const lanes t = add16(src, mul16(dst, inverse));
+      return shift8(add16(t, shift8(t)));
+    };
+
+    for (; i + kWidth <= n; i += kWidth) {
+      const lanes dst = load(p + i);
+      store(p + i, narrow(mix(widen_lo(dst)), mix(widen_hi(dst))));
+    }
+#endif
+    for (; i < n; ++i) p[i] = blend(p[i], paint);
+  }
+
+  // Widest dx with dx * dx + dy * dy <= r * r + r, which rounds off the
+  // flat sides a plain r * r leaves at the four extremes.  -1 when the row
+  // misses the circle.
+  int half_width(int r, int dy) {
+    const int limit = r * r + r - dy * dy;
+    if (r < 0 || limit < 0) return -1;
+
+    int w = (int)std::sqrt((float)limit);
+    while (w * w > limit) --w;
+    while ((w + 1) * (w + 1) <= limit) ++w;
+    return w;
+  }
+}
+
+Framebuffer::Framebuffer(int width, int height, int scale) :
+  width_(width), height_(height), scale_(scale),
+  stride_(width * scale),
+  pixels_((size_t)stride_ * height * scale) {}
+
+void Framebuffer::clear(uint32_t color) {
+  std::fill(pixels_.begin(), pixels_.end(), color >> 8);
+}
+
+void Framebuffer::span(int y, int x1, int x2, uint32_t color) {
+  if (y < 0 || y >= height_) return;
+  x1 = std::max(x1, 0);
+  x2 = std::min(x2, width_);
+  if (x1 >= x2) return;
+
+  const Paint paint(color);
+  for (int row = y * scale_; row < (y + 1) * scale_; ++row) {
+    fill(pixels_.data() + (size_t)row * stride_ + x1 * scale_, (x2 - x1) * scale_, paint);
+  }
+}
+
+void Framebuffer::draw_pixel(const Point& p, uint32_t color) {
+  span(p.y, p.x, p.x + 1, color);
+}
+
+// Bresenham with both ends drawn like SDL does.  Steps along the same row are
+// gathered up so each row is one span and no pixel blends twice.
+void Framebuffer::draw_line(const Point& p1, const Point& p2, uint32_t color) {
+  const int dx = std::abs(p2.x - p1.x), dy = -std::abs(p2.y - p1.y);
+  const int sx = p1.x < p2.x ? 1 : -1, sy = p1.y < p2.y ? 1 : -1;
+
+  int err = dx + dy;
+  int x = p1.x, y = p1.y, from = p1.x;
+  while (x != p2.x || y != p2.y) {
+    const int e2 = 2 * err;
+    int nx = x, ny = y;
+    if (e2 >= dy) {
+      err += dy;
+      nx += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      ny += sy;
+    }
+
+    if (ny != y) {
+      span(y, std::min(from, x), std::max(from, x) + 1, color);
+      from = nx;
+    }
+    x = nx;
+    y = ny;
+  }
+
+  span(y, std::min(from, x), std::max(from, x) + 1, color);
+}
+
+// The same area as an SDL_Rect from p1 to p2, so p2 itself is just outside.
+void Framebuffer::draw_rect(const Point& p1, const Point& p2, uint32_t color, bool filled) {
+  const int left = std::min(p1.x, p2.x), right = std::max(p1.x, p2.x);
+  const int top = std::min(p1.y, p2.y), bottom = std::max(p1.y, p2.y);
+  if (left == right || top == bottom) return;
+
+  if (filled) {
+    for (int y = std::max(top, 0); y < std::min(bottom, height_); ++y) span(y, left, right, color);
+    return;
+  }
+
+  span(top, left, right, color);
+  if (bottom - 1 > top) span(bottom - 1, left, right, color);
+  for (int y = std::max(top + 1, 0); y < std::min(bottom - 1, height_); ++y) {
+    span(y, left, left + 1, color);
+    if (right - 1 > left) span(y, right - 1, right, color);
+  }
+}
+
+// An outline is whatever of the circle isn't also inside one a pixel smaller.
+void Framebuffer::draw_circle(const Point& center, int radius, uint32_t color, bool filled) {
+  for (int dy = -radius; dy <= radius; ++dy) {
+    const int outer = half_width(radius, dy);
+    if (outer < 0) continue;
+
+    const int y = center.y + dy;
+    const int inner = filled ? -1 : half_width(radius - 1, dy);
+    if (inner < 0) {
+      span(y, center.x - outer, center.x + outer + 1, color);
+    } else {
+      span(y, center.x - outer, center.x - inner, color);
+      span(y, center.x + inner + 1, center.x + outer + 1, color);
+    }
+  }
+}
+
+bool Framebuffer::write_ppm(const std::string& path) const {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) return false;
+
+  out << "P6\n" << stride_ << " " << height_ * scale_ << "\n255\n";
+
+  std::vector<char> row(3 * (size_t)stride_);
+  for (int y = 0; y < height_ * scale_; ++y) {
+    const uint32_t* p = pixels_.data() + (size_t)y * stride_;
+    for (int x = 0; x < stride_; ++x) {
+      row[3 * x] = (char)(p[x] >> 16);
+      row[3 * x + 1] = (char)(p[x] >> 8);
+      row[3 * x + 2] = (char)p[x];
+    }
+    out.write(row.data(), row.size());
+  }
+
+  return out.good();
+}
+
+bool Framebuffer::read_ppm(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int width, height, depth;
+  if (!(in >> magic >> width >> height >> depth) || magic != "P6" || depth != 255) return false;
+  if (width != stride_ || height != height_ * scale_) return false;
+  in.get();
+
+  std::vector<unsigned char> row(3 * (size_t)stride_);
+  for (int y = 0; y < height; ++y) {
+    if (!in.read((char*)row.data(), row.size())) return false;
+
+    uint32_t* p = pixels_.data() + (size_t)y * stride_;
+    for (int x = 0; x < stride_; ++x) {
+      p[x] = (uint32_t)row[3 * x] << 16 | (uint32_t)row[3 * x + 1] << 8 | row[3 * x + 2];
+    }
+  }
+
+  return true;
+}
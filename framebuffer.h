@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "graphics.h"
+
+// A software target with the same drawing calls as Graphics, for rendering
+// without a display.  Coordinates are logical like they are for Graphics and
+// every logical pixel covers scale by scale real ones, the way intscale
+// presents them.  Colors are RGBA and blend over what is there already the
+// same way SDL's blend mode does, rounded exactly, so a frame comes out the
+// same on every machine.  Everything is drawn as horizontal spans filled with
+// AVX2 or SSE2 when built for them.
+class Framebuffer {
+  public:
+
+    using Point = Graphics::Point;
+
+    Framebuffer(int width, int height, int scale = 1);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int scale() const { return scale_; }
+
+    void clear(uint32_t color = 0x000000ff);
+
+    void draw_pixel(const Point& p, uint32_t color);
+    void draw_line(const Point& p1, const Point& p2, uint32_t color);
+    void draw_rect(const Point& p1, const Point& p2, uint32_t color, bool filled);
+    void draw_circle(const Point& center, int radius, uint32_t color, bool filled);
+
+    // Real pixels as 0x00RRGGBB, row by row, width() * scale() to a row.
+    const std::vector<uint32_t>& pixels() const { return pixels_; }
+
+    // Binary PPM, for golden images.  Reading fails unless the image is the
+    // same size as this framebuffer.
+    bool write_ppm(const std::string& path) const;
+    bool read_ppm(const std::string& path);
+
+  private:
+
+    int width_, height_, scale_;
+    int stride_;
+    std::vector<uint32_t> pixels_;
+
+    // logical pixels [x1, x2) of row y, clipped to the screen
+    void span(int y, int x1, int x2, uint32_t color);
+};
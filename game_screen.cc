@@ -1,11 +1,187 @@
 #include "game_screen.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#include "entt/entity/snapshot.hpp"
+
 #include "util.h"
 
 #include "components.h"
 #include "config.h"
+#include "pipeline.h"
+#include "snapshot.h"
+
+namespace {
+  // how far boids can see their flockmates and how close is too close
+  constexpr float kSight = 75.0f;
+  constexpr float kCrowding = 20.0f;
+
+  // roughly twice the biggest box so most boxes only touch a few cells
+  constexpr float kCollisionCell = 40.0f;
+
+  // how close to the edge things that stay in bounds start turning back
+  constexpr float kBoundsBuffer = 25.0f;
+
+  // Most ticks update() will run before giving up on catching up.  Without a
+  // limit a slow frame means more ticks next frame, which makes it slower.
+  constexpr int kMaxTicks = 5;
+
+  // anything that moved further than this in one tick wrapped around the screen
+  constexpr float kTeleport = 100.0f;
+
+  // particles in an explosion at full detail
+  constexpr size_t kSparks = 500;
+
+  // stand-in for shared state in the scheduler's read and write sets
+  struct Score {};
+
+  template <typename... T> struct Types {};
+
+  // Every component, in the order snapshots number their pools.
+  using Components = Types<
+    Health, Position, Size, Velocity, Angle, Vector, Previous, MaxVelocity, Accelleration, Rotation, TargetDir, Color,
+    Bullet, Firing, Bomb, ScreenWrap, PlayerControl, Collision, Timer, Flash, FadeOut,
+    Flocking, StayInBounds, KillOffScreen>;
+
+  // Every pool is made up front so systems running in parallel never have to
+  // add one to the registry.
+  template <typename... T>
+  void assure(entt::registry& reg, Types<T...>) {
+    (static_cast<void>(reg.storage<T>()), ...);
+  }
+
+  template <typename... T>
+  void reserve_pools(entt::registry& reg, size_t n) {
+    (reg.storage<T>().reserve(n), ...);
+  }
+
+  // Boxes and bullets, which all have a top speed.  Owning the pools keeps
+  // these components packed in the same order so the hot loops walk them
+  // side by side.
+  auto movers(entt::registry& reg) {
+    return reg.group<Position, Vector, Previous>(entt::get<MaxVelocity>);
+  }
+
+  // Boxes, nested inside movers so both groups can own the same pools.
+  auto boids(entt::registry& reg) {
+    return reg.group<Position, Vector, Previous, TargetDir>(entt::get<MaxVelocity, Flocking>);
+  }
+}
+
+namespace {
+  struct Accelerate {
+    float t;
+    explicit Accelerate(float t) : t(t) {}
+
+    void operator()(Velocity& v, const Accelleration& a) const {
+      v.vel = (v.vel + a.accel * t) * 0.99;
+    }
+  };
+
+  struct Rotate {
+    float t;
+    explicit Rotate(float t) : t(t) {}
+
+    void operator()(Angle& a, const Rotation& r) const {
+      a.angle += r.rot * t;
+    }
+  };
+
+  // Turns velocities toward their target by at most t radians a second
+  // without changing speed.  The turn is a rotation by a fixed angle so the
+  // only trig is done once a pass.
+  struct Steer {
+    float cos_t, sin_t;
+    explicit Steer(float t) : cos_t(std::cos(t)), sin_t(std::sin(t)) {}
+
+    void operator()(Vector& vector, const TargetDir& dir) const {
+      pos& v = vector.v;
+      const pos target = dir.target;
+
+      const float len2 = v.mag2();
+      const float target2 = target.mag2();
+      if (len2 == 0 || target2 == 0) return;
+
+      // within t of the target when the cosine of the gap is at least cos(t)
+      const float dot = v.dot(target);
+      if (dot > 0 && dot * dot >= cos_t * cos_t * len2 * target2) {
+        v = target * std::sqrt(len2 / target2);
+      } else {
+        const float s = v.cross(target) < 0 ? -sin_t : sin_t;
+        v = { v.x * cos_t - v.y * s, v.x * s + v.y * cos_t };
+      }
+    }
+  };
+
+  struct LimitVector {
+    void operator()(Vector& v, const MaxVelocity& max) const {
+      const float speed = std::sqrt(v.v.mag2());
+      if (speed > max.max) v.v *= max.max / speed;
+    }
+  };
+
+  struct Remember {
+    void operator()(Previous& prev, const Position& p, const Vector& v) const {
+      prev = { p.p, v.v };
+    }
+  };
+
+  struct Translate {
+    void operator()(Position& p, const Vector& v) const {
+      p.p += v.v;
+    }
+  };
+
+  // Clamping the speed of vector movers happens in the same pass that moves
+  // them, so each box is only loaded once.
+  using Move = Pipeline<LimitVector, Translate>;
+
+  void wrap(pos& p) {
+    while (p.x < 0) p.x += kConfig.graphics.width;
+    while (p.x > kConfig.graphics.width) p.x -= kConfig.graphics.width;
+    while (p.y < 0) p.y += kConfig.graphics.height;
+    while (p.y > kConfig.graphics.height) p.y -= kConfig.graphics.height;
+  }
+}
+
+GameScreen::GameScreen() : GameScreen(Options{ Util::random_seed() }) {}
+
+GameScreen::GameScreen(const Options& options) :
+  commands_(reg_),
+  rng_(options.seed),
+  text_("text.png"),
+  flock_(kSight, kCrowding, kConfig.graphics.width, kConfig.graphics.height, options.flock_theta),
+  budget_(options.budget),
+  slice_(0),
+  collision_grid_(kCollisionCell, kConfig.graphics.width, kConfig.graphics.height),
+  particles_(options.particles, rect{
+      kBoundsBuffer, kBoundsBuffer,
+      kConfig.graphics.width - kBoundsBuffer, kConfig.graphics.height - kBoundsBuffer }),
+  state_(state::playing),
+  score_(0),
+  show_profile_(false),
+  pool_(options.threads),
+  scheduler_(pool_, profiler_),
+  tick_(options.tick),
+  accumulator_(0),
+  held_(0),
+  pressed_(0),
+  threaded_(options.threaded),
+  running_(false) {
+  if (options.counters) profiler_.count_hardware();
+  if (options.trace) profiler_.trace();
+
+  prepare();
+
+  capacity_ = options.capacity;
+  if (capacity_.boxes == 0) capacity_.boxes = options.boxes;
+  reserve(capacity_);
 
-GameScreen::GameScreen() : rng_(Util::random_seed()), text_("text.png"), state_(state::playing), score_(0) {
   const auto player = reg_.create();
   reg_.emplace<Color>(player, 0xd8ff00ff);
   reg_.emplace<Position>(player, pos{ kConfig.graphics.width / 2.0f, kConfig.graphics.height / 2.0f});
@@ -15,75 +191,385 @@ GameScreen::GameScreen() : rng_(Util::random_seed()), text_("text.png"), state_(
   reg_.emplace<Accelleration>(player);
   reg_.emplace<Velocity>(player, 0.0f);
   reg_.emplace<Angle>(player, 0.0f);
+  reg_.emplace<Previous>(player, reg_.get<Position>(player).p, pos{ 1.0f, 0.0f });
   reg_.emplace<Rotation>(player);
   reg_.emplace<Size>(player, 20.0f);
-  reg_.emplace<Health>(player, 100);
+  reg_.emplace<Health>(player, options.player_health);
 
-  add_box(1000);
+  add_box(options.boxes);
+  schedule();
+
+  if (!options.record.empty() && !recording_.open(options.record, { options.seed, options.tick, options.boxes })) {
+    std::fprintf(stderr, "unable to record to %s\n", options.record.c_str());
+  }
 }
 
-bool GameScreen::update(const Input& input, Audio& audio, unsigned int elapsed) {
-  const float t = elapsed / 1000.0f;
-  expiring(t);
+void GameScreen::reserve(const Capacity& capacity) {
+  // the player counts as one of everything
+  const size_t boxes = capacity.boxes + 1;
+  const size_t movers = boxes + capacity.bullets;
+
+  reg_.storage<entt::entity>().reserve(movers + capacity.effects);
+  reserve_pools<Position, Previous, Vector, MaxVelocity>(reg_, movers);
+  reserve_pools<Health, Size, Collision, TargetDir, Flocking, StayInBounds>(reg_, boxes);
+  reserve_pools<Color>(reg_, boxes + capacity.effects);
+  reserve_pools<Bullet, KillOffScreen>(reg_, capacity.bullets);
+  reserve_pools<Timer, Flash, FadeOut>(reg_, capacity.effects);
+
+  // scratch space and everything a frame is drawn from, for the same load
+  movers_.reserve(movers);
+  boids_.reserve(boxes);
+  commands_.reserve(movers + capacity.effects);
+
+  const auto reserve_state = [&](RenderState& rs) { rs.reserve(particles_.capacity(), boxes, capacity.bullets); };
+  reserve_state(snapshot_);
+  snapshots_.each(reserve_state);
+  lines_.reserve(4 * boxes);
+
+  // a rect and a heading per square, a pixel per particle, a circle per
+  // bullet and a few more for the overlay
+  batch_.reserve(2 * boxes + particles_.capacity() + capacity.bullets + 16);
+
+  samples_.reserve(SoundEvents::kSamples);
+  spark_life_.reserve(kSparks);
+  spark_x_.reserve(kSparks);
+  spark_y_.reserve(kSparks);
+}
 
-  switch (state_) {
-    case state::playing:
-      if (input.key_pressed(Input::Button::Start)) {
-        state_ = state::paused;
+void GameScreen::prepare() {
+  assure(reg_, Components{});
+
+  // Made while the pools are empty so there is nothing to sort.
+  movers(reg_);
+  boids(reg_);
+}
+
+namespace {
+  // tags for the snapshot blocks that aren't component pools, which are
+  // numbered by their place in Components
+  constexpr uint32_t kEntities = 0x100;
+  constexpr uint32_t kGame = 0x101;
+  constexpr uint32_t kParticles = 0x200;  // one tag per column from here
+
+  struct Saved {
+    uint64_t score, state;
+    uint64_t accumulator, slice;
+    uint64_t held, pressed;
+    Rng::State rng;
+  };
+
+  template <typename T>
+  constexpr uint32_t element_size() {
+    return std::is_empty_v<T> ? 0 : sizeof(T);
+  }
+
+  template <typename... T>
+  void save_pools(const entt::registry& reg, SnapshotWriter& out, Types<T...>) {
+    const entt::snapshot snapshot(reg);
+    out.begin(kEntities, 0);
+    snapshot.get<entt::entity>(out);
+
+    uint32_t tag = 0;
+    ((out.begin(tag++, element_size<T>()), snapshot.get<T>(out)), ...);
+  }
+
+  // The ids that are alive in the entity block, by index, so pools can be
+  // checked against it before anything is loaded.
+  class Alive {
+    public:
+
+      explicit Alive(const SnapshotBlock& entities) {
+        for (size_t i = 0; i < entities.in_use; ++i) {
+          const entt::entity e = entities.entities[i];
+          const size_t index = entt::to_entity(e);
+          if (index >= ids_.size()) ids_.resize(index + 1, entt::null);
+          ids_[index] = e;
+        }
+        seen_.resize(ids_.size(), 0);
       }
 
-      user_input(input);
+      // True if every id in the block is alive and none comes up twice.
+      bool check(const SnapshotBlock& block, uint32_t pass) {
+        for (size_t i = 0; i < block.count; ++i) {
+          const entt::entity e = block.entities[i];
+          const size_t index = entt::to_entity(e);
+          if (index >= ids_.size() || ids_[index] != e || seen_[index] == pass) return false;
+          seen_[index] = pass;
+        }
+        return true;
+      }
 
-      // movement systems
-      accelleration(t);
-      rotation(t);
-      steering(t);
-      flocking();
-      stay_in_bounds();
-      max_velocity();
-      movement(t);
+    private:
 
-      // state systems
-      bombing(audio, t);
-      firing(audio, t);
+      std::vector<entt::entity> ids_;
+      std::vector<uint32_t> seen_;  // the last pass each index was seen in
+  };
 
-      // collision systems
-      collision(audio);
+  template <typename T>
+  bool check_pool(const SnapshotFile& file, uint32_t tag, Alive& alive) {
+    const SnapshotBlock* block = file.find(tag);
+    return block && block->entities && block->size == element_size<T>() && alive.check(*block, tag + 1);
+  }
 
-      // cleanup systems
-      kill_dead(audio);
-      kill_oob();
+  template <typename... T>
+  bool check_pools(const SnapshotFile& file, const SnapshotBlock& entities, Types<T...>) {
+    Alive alive(entities);
+    uint32_t tag = 0;
+    return (check_pool<T>(file, tag++, alive) && ...);
+  }
 
-      if (reg_.view<PlayerControl>().size() == 0) {
-        state_ = state::lost;
+  // EnTT writes pools back to front, so they're put back in reverse to come
+  // out in the order they were saved.  Only for blocks check_pool passed.
+  template <typename T>
+  void load_pool(entt::registry& reg, const SnapshotFile& file, uint32_t tag) {
+    const SnapshotBlock* block = file.find(tag);
+    const auto first = std::make_reverse_iterator(block->entities + block->count);
+    const auto last = std::make_reverse_iterator(block->entities);
+    if constexpr (std::is_empty_v<T>) {
+      reg.storage<T>().insert(first, last);
+    } else {
+      reg.storage<T>().insert(first, last, std::make_reverse_iterator(static_cast<const T*>(block->data) + block->count));
+    }
+  }
+
+  template <typename... T>
+  void load_pools(entt::registry& reg, const SnapshotFile& file, Types<T...>) {
+    uint32_t tag = 0;
+    (load_pool<T>(reg, file, tag++), ...);
+  }
+}
+
+// The simulation thread would be changing the world while it's written.
+bool GameScreen::save(const std::string& path) const {
+  if (sim_.joinable()) return false;
+
+  SnapshotWriter out;
+  save_pools(reg_, out, Components{});
+
+  const Saved saved {
+    (uint64_t)score_, (uint64_t)state_,
+    accumulator_, slice_,
+    held_.load(std::memory_order_relaxed), pressed_.load(std::memory_order_relaxed),
+    rng_.state() };
+  out.raw(kGame, sizeof(saved), 1, &saved);
+
+  for (size_t c = 0; c < ParticlePool::kColumns; ++c) {
+    out.raw(kParticles + c, 4, particles_.size(), particles_.column(c));
+  }
+
+  return out.write(path);
+}
+
+// Everything is checked before the world is touched, including that every
+// pool only holds entities alive in the entity block, so a bad snapshot
+// leaves the world as it was.
+bool GameScreen::load(const std::string& path) {
+  if (sim_.joinable()) return false;
+
+  SnapshotFile file;
+  if (!file.open(path)) return false;
+
+  const SnapshotBlock* entities = file.find(kEntities);
+  const SnapshotBlock* game = file.find(kGame);
+  if (!entities || !entities->entities || !game || game->size != sizeof(Saved) || game->count != 1) return false;
+
+  Saved saved;
+  std::memcpy(&saved, game->data, sizeof(saved));
+  if (saved.state > (uint64_t)state::lost) return false;
+
+  const void* columns[ParticlePool::kColumns];
+  size_t sparks = 0;
+  for (size_t c = 0; c < ParticlePool::kColumns; ++c) {
+    const SnapshotBlock* column = file.find(kParticles + c);
+    if (!column || column->size != 4 || (c > 0 && column->count != sparks)) return false;
+    sparks = column->count;
+    columns[c] = column->data;
+  }
+
+  if (!check_pools(file, *entities, Components{})) return false;
+
+  reg_ = entt::registry{};
+  SnapshotIds ids(*entities);
+  entt::snapshot_loader{reg_}.get<entt::entity>(ids);
+  prepare();
+  load_pools(reg_, file, Components{});
+  reserve(capacity_);
+
+  score_ = (int)saved.score;
+  state_ = (state)saved.state;
+  accumulator_ = (unsigned int)saved.accumulator;
+  slice_ = (size_t)saved.slice;
+  held_ = (uint32_t)saved.held;
+  pressed_ = (uint32_t)saved.pressed;
+  rng_ = Rng(saved.rng);
+
+  particles_.restore(sparks, columns);
+  return true;
+}
+
+void GameScreen::schedule() {
+  // movement systems
+  scheduler_.add("accelleration", Pipeline<Accelerate>::reads(), Pipeline<Accelerate>::writes(), [this](float t) { accelleration(t); });
+  scheduler_.add("rotation", Pipeline<Rotate>::reads(), Pipeline<Rotate>::writes(), [this](float t) { rotation(t); });
+  scheduler_.add("steering", Pipeline<Steer>::reads(), Pipeline<Steer>::writes(), [this](float t) { steering(t); });
+  scheduler_.add("flocking", Reads<Flocking, Position, PlayerControl>(), Writes<Vector, TargetDir>(), [this](float) { flocking(); });
+  scheduler_.add("stay_in_bounds", Reads<StayInBounds, Position>(), Writes<Vector>(), [this](float) { stay_in_bounds(); });
+  scheduler_.add("movement", Reads<Velocity, Angle, MaxVelocity, ScreenWrap>(), Writes<Position, Vector>(), [this](float t) { movement(t); });
+  scheduler_.add("particles", Reads<>(), Writes<ParticlePool>(), [this](float t) { particles_.update(t); });
+
+  // state systems
+  scheduler_.add("bombing", Reads<Bomb, Position>(), Writes<CommandBuffer, SoundEvents>(), [this](float t) { bombing(t); });
+  scheduler_.add("firing", Reads<Position, Angle, Velocity>(), Writes<Firing, CommandBuffer, SoundEvents>(), [this](float t) { firing(t); });
+
+  // collision systems
+  scheduler_.add("collision",
+      Reads<Collision, Position, Size, PlayerControl, Bullet>(), Writes<Health, CommandBuffer, SoundEvents>(),
+      [this](float) { collision(); });
+
+  // cleanup systems
+  scheduler_.add("kill_dead",
+      Reads<Health, Position, Color>(), Writes<CommandBuffer, ParticlePool, SoundEvents, Score, Rng>(),
+      [this](float) { kill_dead(); });
+  scheduler_.add("kill_oob", Reads<Position, KillOffScreen>(), Writes<CommandBuffer>(), [this](float) { kill_oob(); });
+}
+
+GameScreen::~GameScreen() {
+  if (sim_.joinable()) {
+    running_ = false;
+    sim_.join();
+  }
+}
+
+bool GameScreen::update(const Input& input, Audio& audio, unsigned int elapsed) {
+  const Controls controls = Controls::read(input);
+  if (recording_.is_open()) recording_.write(elapsed, controls);
+  latch(controls);
+
+  if (threaded_) {
+    if (!sim_.joinable()) {
+      running_ = true;
+      sim_ = std::thread(&GameScreen::run, this);
+    }
+
+    SoundEvents::Sample sample;
+    while (voices_.pop(sample)) audio.play_sample(SoundEvents::name(sample));
+  } else {
+    advance(elapsed, &audio);
+  }
 
-        const auto fade = reg_.create();
-        reg_.emplace<FadeOut>(fade);
-        reg_.emplace<Timer>(fade, 2.5f, false);
-        reg_.emplace<Color>(fade, 0x000000ff);
+  return true;
+}
+
+void GameScreen::replay(const Controls& controls, unsigned int elapsed) {
+  latch(controls);
+  advance(elapsed, nullptr);
+}
+
+// Presses are kept until a tick sees them, in case this frame runs none.
+void GameScreen::latch(const Controls& controls) {
+  held_.store(controls.held, std::memory_order_relaxed);
+  pressed_.fetch_or(controls.pressed, std::memory_order_relaxed);
+}
+
+void GameScreen::advance(unsigned int elapsed, Audio* audio) {
+  accumulator_ += elapsed;
+  for (int ticks = 0; accumulator_ >= tick_; ++ticks) {
+    if (ticks == kMaxTicks) {
+      accumulator_ %= tick_;
+      break;
+    }
+
+    step();
+    accumulator_ -= tick_;
+    if (audio) {
+      for (const auto sample : samples_) audio->play_sample(SoundEvents::name(sample));
+    }
+  }
+}
+
+void GameScreen::step() {
+  const Controls controls {
+    held_.load(std::memory_order_relaxed),
+    pressed_.exchange(0, std::memory_order_relaxed) };
+  simulate(controls, tick_);
+}
+
+// The simulation thread ticks at a fixed rate regardless of how fast frames
+// are drawn, publishing a snapshot for draw() and its sounds for update()
+// after every tick.  If it falls well behind it gives up on catching up.
+void GameScreen::run() {
+  using clock = std::chrono::steady_clock;
+  const auto tick = std::chrono::milliseconds(tick_);
+  auto next = clock::now();
+
+  while (running_) {
+    step();
+
+    capture(snapshots_.back());
+    snapshots_.publish();
+    for (const auto sample : samples_) voices_.push(sample);
+
+    next += tick;
+    const auto now = clock::now();
+    if (now - next > 4 * tick) next = now;
+    std::this_thread::sleep_until(next);
+  }
+}
+
+void GameScreen::simulate(const Controls& input, unsigned int elapsed) {
+  const auto start = Profiler::clock::now();
+  Profiler::Scope frame(profiler_, "update");
+
+  const float t = elapsed / 1000.0f;
+  samples_.clear();
+
+  if (input.key_pressed(Input::Button::B)) show_profile_ = !show_profile_;
+  profiler_.time("remember", [&] { remember(); });
+  profiler_.time("expiring", [&] { expiring(t); });
+
+  switch (state_) {
+    case state::playing:
+      if (input.key_pressed(Input::Button::Start)) {
+        state_ = state::paused;
       }
 
+      profiler_.time("user_input", [&] { user_input(input); });
+      scheduler_.run(t);
       break;
 
     case state::paused:
       if (input.key_pressed(Input::Button::Start)) {
         state_ = state::playing;
       }
+
+      profiler_.time("particles", [&] { particles_.age(t); });
       break;
 
     default:
-      // do nothing
+      profiler_.time("particles", [&] { particles_.age(t); });
       break;
 
   }
 
-  return true;
+  // sync point for everything the systems created or destroyed
+  profiler_.time("commands", [&] { commands_.flush(); });
+  sounds_.mix(elapsed, samples_);
+
+  if (state_ == state::playing && reg_.view<PlayerControl>().size() == 0) {
+    state_ = state::lost;
+
+    const auto fade = reg_.create();
+    reg_.emplace<FadeOut>(fade);
+    reg_.emplace<Timer>(fade, 2.5f, false);
+    reg_.emplace<Color>(fade, 0x000000ff);
+  }
+
+  budget_.record(std::chrono::duration<float, std::milli>(Profiler::clock::now() - start).count());
 }
 
 namespace {
-  rect get_rect(const pos& p, float size) {
-    return { p.x - size / 2, p.y - size / 2, p.x + size / 2, p.y + size / 2 };
-  }
+  // darkens the screen behind the pause box
+  constexpr uint32_t kPauseDim = 0x00000099;
 
   uint32_t color_opacity(uint32_t color, float opacity) {
     const uint32_t lsb = (uint32_t)((color & 0xff) * std::clamp(opacity, 0.0f, 1.0f));
@@ -91,144 +577,381 @@ namespace {
   }
 }
 
-void GameScreen::draw(Graphics& graphics) const {
-  draw_flash(graphics);
-  draw_particles(graphics);
-  draw_squares(graphics);
-  draw_bullets(graphics);
-  draw_overlay(graphics);
-}
+void GameScreen::capture(RenderState& rs) const {
+  rs.clear();
 
-void GameScreen::draw_flash(Graphics& graphics) const {
+  // Flashes are the first thing drawn, over the black the screen is cleared
+  // to, so they fold into one opaque color.
+  Compositor under;
   const auto flashes = reg_.view<const Flash, const Timer, const Color>();
   for (const auto f : flashes) {
-    const uint32_t c = color_opacity(flashes.get<const Color>(f).color, 1 - (flashes.get<const Timer>(f).ratio()));
-    graphics.draw_rect({0, 0}, {graphics.width(), graphics.height()}, c, true);
+    under.add(color_opacity(flashes.get<const Color>(f).color, 1 - (flashes.get<const Timer>(f).ratio())));
+  }
+  if (under.layers() > 0) rs.flash = under.over(0x000000ff);
+
+  particles_.each([&rs](const pos prev, const pos p, uint32_t color, float ratio) {
+    rs.particles.push_back({ prev, p, color_opacity(color, 1 - ratio) });
+  });
+
+  const auto square = [this, &rs](entt::entity s, const pos heading, bool filled) {
+    const pos p = reg_.get<const Position>(s).p;
+    const Previous& prev = reg_.get<const Previous>(s);
+    rs.squares.push_back({
+        prev.p.dist2(p) > kTeleport * kTeleport ? p : prev.p, p,
+        prev.heading, heading,
+        reg_.get<const Size>(s).size,
+        reg_.get<const Color>(s).color,
+        filled });
+  };
+
+  // Only the player is drawn filled, and the player turns rather than having
+  // a velocity vector, so only the turners need to be checked.
+  const auto boxes = reg_.view<const Position, const Previous, const Size, const Color, const Vector>();
+  for (const auto s : boxes) square(s, boxes.get<const Vector>(s).v, false);
+
+  const auto turners = reg_.view<const Position, const Previous, const Size, const Color, const Angle>();
+  for (const auto s : turners) {
+    square(s, pos::polar(1.0f, turners.get<const Angle>(s).angle), reg_.all_of<PlayerControl>(s));
+  }
+
+  const auto bullets = reg_.view<const Position, const Previous, const Bullet>();
+  for (const auto b : bullets) {
+    rs.bullets.push_back({ bullets.get<const Previous>(b).p, bullets.get<const Position>(b).p });
+  }
+
+  Compositor over;
+  const auto fade = reg_.view<const FadeOut, const Timer, const Color>();
+  for (const auto f : fade) {
+    over.add(color_opacity(fade.get<const Color>(f).color, fade.get<const Timer>(f).ratio()));
   }
+  if (state_ == state::paused) over.add(kPauseDim);
+  rs.overlay = over.color();
+  rs.layers = under.layers() + over.layers();
+
+  const auto players = reg_.view<const PlayerControl, const Color, const Health>();
+  for (const auto p : players) {
+    rs.players.push_back({ players.get<const Color>(p).color, players.get<const Health>(p).health / 100.0f });
+  }
+
+  rs.score = score_;
+  rs.paused = state_ == state::paused;
+  rs.lost = state_ == state::lost;
+  rs.show_profile = show_profile_;
+  rs.slices = budget_.slices();
+  rs.detail = budget_.detail();
+  rs.time = std::chrono::steady_clock::now();
 }
 
-void GameScreen::draw_particles(Graphics& graphics) const {
-  const auto particles = reg_.view<const Particle, const Timer, const Position, const Color>();
-  for (const auto pt : particles) {
-    const pos p = particles.get<const Position>(pt).p;
-    graphics.draw_pixel({ (int)p.x, (int)p.y }, color_opacity(particles.get<const Color>(pt).color, 1 - particles.get<const Timer>(pt).ratio()));
+namespace {
+  // FNV-1a, fed one value at a time
+  class Hash {
+    public:
+
+      void add(uint64_t bits) {
+        for (int i = 0; i < 8; ++i) {
+          hash_ = (hash_ ^ ((bits >> (8 * i)) & 0xff)) * 0x100000001b3ull;
+        }
+      }
+
+      void add(float f) {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        add((uint64_t)bits);
+      }
+
+      void add(const pos p) {
+        add(p.x);
+        add(p.y);
+      }
+
+      uint64_t value() const { return hash_; }
+
+    private:
+
+      uint64_t hash_ = 0xcbf29ce484222325ull;
+  };
+}
+
+// Everything with a position, in entity order so the result doesn't depend on
+// how the pools happen to be sorted, then the particles and the score.
+uint64_t GameScreen::checksum() const {
+  const auto view = reg_.view<const Position>();
+  std::vector<entt::entity> entities(view.begin(), view.end());
+  std::sort(entities.begin(), entities.end());
+
+  Hash hash;
+  for (const auto e : entities) {
+    hash.add((uint64_t)entt::to_integral(e));
+    hash.add(view.get<const Position>(e).p);
+    if (const auto* v = reg_.try_get<const Vector>(e)) hash.add(v->v);
+    if (const auto* v = reg_.try_get<const Velocity>(e)) hash.add(v->vel);
+    if (const auto* a = reg_.try_get<const Angle>(e)) hash.add(a->angle);
+    if (const auto* h = reg_.try_get<const Health>(e)) hash.add((uint64_t)h->health);
+    if (const auto* s = reg_.try_get<const Size>(e)) hash.add(s->size);
+    if (const auto* c = reg_.try_get<const Color>(e)) hash.add((uint64_t)c->color);
   }
+
+  particles_.each([&hash](const pos, const pos p, uint32_t color, float ratio) {
+    hash.add(p);
+    hash.add((uint64_t)color);
+    hash.add(ratio);
+  });
+
+  hash.add((uint64_t)score_);
+  hash.add((uint64_t)state_);
+  return hash.value();
 }
 
-void GameScreen::draw_squares(Graphics& graphics) const {
-  const auto squarez = reg_.view<const Position, const Size, const Color, const Angle>();
-  for (const auto s : squarez) {
-    const pos p = squarez.get<const Position>(s).p;
-    const float size = squarez.get<const Size>(s).size;
-    const rect r = get_rect(p, size);
-    const bool filled = reg_.all_of<PlayerControl>(s);
+void GameScreen::draw(Graphics& graphics) const {
+  float alpha;
+  const RenderState& rs = latest(alpha);
+
+  {
+    Profiler::Scope frame(profiler_, "draw");
 
-    graphics.draw_rect({ (int)r.left, (int)r.top }, { (int)r.right, (int)r.bottom }, squarez.get<const Color>(s).color, filled);
-    const float angle = reg_.get<const Angle>(s).angle;
-    graphics.draw_line({ (int)p.x, (int)p.y }, { (int)(p.x + size * std::cos(angle)), (int)(p.y + size * std::sin(angle)) }, 0xffffffff);
+    compose(rs, alpha, graphics.width(), graphics.height());
+    profiler_.time("draw_flush", [&] { batch_.flush(graphics); });
+    profiler_.time("draw_text", [&] { draw_text(rs, graphics); });
+    fill_.pixels = batch_.pixels();
   }
+
+  if (rs.show_profile) draw_profile(rs, graphics);
 }
 
-void GameScreen::draw_bullets(Graphics& graphics) const {
-  const auto bullets = reg_.view<const Position, const Bullet>();
-  for (const auto b : bullets) {
-    const pos p = bullets.get<const Position>(b).p;
-    graphics.draw_circle({ (int)p.x, (int)p.y }, 2, 0xffffffff, true);
+void GameScreen::render(Framebuffer& framebuffer) const {
+  float alpha;
+  const RenderState& rs = latest(alpha);
+
+  Profiler::Scope frame(profiler_, "draw");
+
+  framebuffer.clear();
+  compose(rs, alpha, framebuffer.width(), framebuffer.height());
+  profiler_.time("draw_flush", [&] { batch_.flush(framebuffer); });
+  fill_.pixels = batch_.pixels();
+}
+
+// The newest snapshot and how far the display is between the tick it came
+// from and the one before it.
+const RenderState& GameScreen::latest(float& alpha) const {
+  if (threaded_) {
+    snapshots_.update();
+    const RenderState& rs = snapshots_.front();
+    const std::chrono::duration<float, std::milli> since = std::chrono::steady_clock::now() - rs.time;
+    alpha = std::min(since.count() / tick_, 1.0f);
+    return rs;
   }
+
+  profiler_.time("capture", [&] { capture(snapshot_); });
+  alpha = accumulator_ / (float)tick_;
+  return snapshot_;
 }
 
-namespace {
-  void text_box(Graphics& graphics, const Text& text, const std::string& msg) {
-    static const int width = 50;
-    static const int height = 20;
+// Batches everything but the text, in the order it layers.
+void GameScreen::compose(const RenderState& rs, float alpha, int width, int height) const {
+  profiler_.time("draw_flash", [&] { draw_flash(rs, width, height, batch_); });
+  profiler_.time("draw_particles", [&] { draw_particles(rs, alpha, batch_); });
+  profiler_.time("draw_squares", [&] { draw_squares(rs, alpha, batch_); });
+  profiler_.time("draw_bullets", [&] { draw_bullets(rs, alpha, batch_); });
+  profiler_.time("draw_overlay", [&] { draw_overlay(rs, width, height, batch_); });
+
+  fill_.layers = rs.layers;
+  fill_.fills = (rs.flash & 0xff ? 1 : 0) + (rs.overlay & 0xff ? 1 : 0);
+}
+
+void GameScreen::draw_flash(const RenderState& rs, int width, int height, DrawBatch& batch) const {
+  if (rs.flash & 0xff) batch.draw_rect({0, 0}, {width, height}, rs.flash, true);
+}
+
+void GameScreen::draw_particles(const RenderState& rs, float alpha, DrawBatch& batch) const {
+  for (const auto& pt : rs.particles) {
+    const pos p = lerp(pt.prev, pt.p, alpha);
+    batch.draw_pixel({ (int)p.x, (int)p.y }, pt.color);
+  }
+}
 
-    const Graphics::Point p1 { graphics.width() / 2 - width, graphics.height() / 2 - height };
-    const Graphics::Point p2 { graphics.width() / 2 + width, graphics.height() / 2 + height };
+void GameScreen::draw_squares(const RenderState& rs, float alpha, DrawBatch& batch) const {
+  // Headings only become angles here, for the whole frame at once.
+  const size_t n = rs.squares.size();
+  lines_.resize(4 * n);
+  float* const a = lines_.data();
+  float* const b = a + n;
+  float* const c = b + n;
+  float* const d = c + n;
+
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = rs.squares[i].prev_heading.x;
+    b[i] = rs.squares[i].prev_heading.y;
+    c[i] = rs.squares[i].heading.x;
+    d[i] = rs.squares[i].heading.y;
+  }
 
-    graphics.draw_rect(p1, p2, 0x000000ff, true);
-    graphics.draw_rect(p1, p2, 0xffffffff, false);
-    text.draw(graphics, msg, graphics.width() / 2, graphics.height() / 2 - 8, Text::Alignment::Center);
+  atan2_n(b, a, a, n);
+  atan2_n(d, c, c, n);
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = lerp_angle(a[i], c[i], alpha);
+    b[i] = rs.squares[i].size;
   }
+  polar_n(b, a, c, d, n);
+
+  for (size_t i = 0; i < n; ++i) {
+    const auto& s = rs.squares[i];
+    const pos p = lerp(s.prev, s.p, alpha);
+    const rect r = get_rect(p, s.size);
 
-  void health_box(Graphics& graphics, const Graphics::Point p1, const Graphics::Point p2, uint32_t color, float fullness) {
-    graphics.draw_rect(p1, p2, 0x000000ff, true);
-    graphics.draw_rect(p1, { p1.x + (int)((p2.x - p1.x) * fullness), p2.y }, color, true);
-    graphics.draw_rect(p1, p2, color, false);
+    batch.draw_rect({ (int)r.left, (int)r.top }, { (int)r.right, (int)r.bottom }, s.color, s.filled);
+    batch.draw_line({ (int)p.x, (int)p.y }, { (int)(p.x + c[i]), (int)(p.y + d[i]) }, 0xffffffff);
   }
 }
 
-void GameScreen::draw_overlay(Graphics& graphics) const {
-  const auto fade = reg_.view<const FadeOut, const Timer, const Color>();
-  for (const auto f : fade) {
-    const uint32_t c = color_opacity(fade.get<const Color>(f).color, fade.get<const Timer>(f).ratio());
-    graphics.draw_rect({0, 0}, {graphics.width(), graphics.height()}, c, true);
+void GameScreen::draw_bullets(const RenderState& rs, float alpha, DrawBatch& batch) const {
+  for (const auto& b : rs.bullets) {
+    const pos p = lerp(b.prev, b.p, alpha);
+    batch.draw_circle({ (int)p.x, (int)p.y }, 2, 0xffffffff, true);
   }
+}
+
+namespace {
+  constexpr int kTextBoxWidth = 50;
+  constexpr int kTextBoxHeight = 20;
+
+  void text_box(DrawBatch& batch, int width, int height) {
+    const Graphics::Point p1 { width / 2 - kTextBoxWidth, height / 2 - kTextBoxHeight };
+    const Graphics::Point p2 { width / 2 + kTextBoxWidth, height / 2 + kTextBoxHeight };
 
-  if (state_ == state::paused) {
-    graphics.draw_rect({0, 0}, {graphics.width(), graphics.height()}, 0x00000099, true);
-    text_box(graphics, text_, "Paused");
-  } else if (state_ == state::lost) {
-    text_box(graphics, text_, "Game Over");
+    batch.draw_rect(p1, p2, 0x000000ff, true);
+    batch.draw_rect(p1, p2, 0xffffffff, false);
   }
 
-  text_.draw(graphics, std::to_string(score_), graphics.width(), 0, Text::Alignment::Right);
+  void health_box(DrawBatch& batch, const Graphics::Point p1, const Graphics::Point p2, uint32_t color, float fullness) {
+    batch.draw_rect(p1, p2, 0x000000ff, true);
+    batch.draw_rect(p1, { p1.x + (int)((p2.x - p1.x) * std::clamp(fullness, 0.0f, 1.0f)), p2.y }, color, true);
+    batch.draw_rect(p1, p2, color, false);
+  }
+}
+
+void GameScreen::draw_overlay(const RenderState& rs, int width, int height, DrawBatch& batch) const {
+  if (rs.overlay & 0xff) batch.draw_rect({0, 0}, {width, height}, rs.overlay, true);
+  if (rs.paused || rs.lost) text_box(batch, width, height);
 
   // TODO make work for multiple players
-  const auto players = reg_.view<const PlayerControl, const Color, const Health>();
-  for (const auto p : players) {
-    const Graphics::Point start {0, graphics.height() - 16};
-    const Graphics::Point end {graphics.width(), graphics.height()};
-    health_box(graphics, start, end, players.get<const Color>(p).color, players.get<const Health>(p).health / 100.0f);
+  for (const auto& p : rs.players) {
+    const Graphics::Point start {0, height - 16};
+    const Graphics::Point end {width, height};
+    health_box(batch, start, end, p.color, p.health);
   }
 }
 
-void GameScreen::add_box(size_t count) {
-  std::uniform_real_distribution<float> hue(0, 260);
-  std::uniform_int_distribution<int> size(10, 20);
-  std::uniform_int_distribution<int> px(0, kConfig.graphics.width);
-  std::uniform_int_distribution<int> py(0, kConfig.graphics.height);
-  std::uniform_real_distribution<float> angle(0, 2 * M_PI);
-  std::uniform_real_distribution<float> velocity(1, 5);
+// Text can only go through Graphics, so it goes on top of everything else.
+void GameScreen::draw_text(const RenderState& rs, Graphics& graphics) const {
+  if (rs.paused || rs.lost) {
+    text_.draw(graphics, rs.paused ? "Paused" : "Game Over", graphics.width() / 2, graphics.height() / 2 - 8, Text::Alignment::Center);
+  }
+
+  text_.draw(graphics, std::to_string(rs.score), graphics.width(), 0, Text::Alignment::Right);
+}
+
+void GameScreen::draw_profile(const RenderState& rs, Graphics& graphics) const {
+  char line[64];
+  int y = 0;
+
+  std::snprintf(line, sizeof(line), "%-16s %7s %7s %7s", "ms", "min", "avg", "p99");
+  text_.draw(graphics, line, 0, y, Text::Alignment::Left);
 
+  for (const auto& s : profiler_.stats()) {
+    y += 16;
+    std::snprintf(line, sizeof(line), "%-16s %7.3f %7.3f %7.3f", s.name, s.min, s.avg, s.p99);
+    text_.draw(graphics, line, 0, y, Text::Alignment::Left);
+  }
+
+  y += 16;
+  std::snprintf(line, sizeof(line), "%zu primitives in %zu draw calls", batch_.primitives(), batch_.draw_calls());
+  text_.draw(graphics, line, 0, y, Text::Alignment::Left);
+
+  y += 16;
+  std::snprintf(line, sizeof(line), "%.2f Mpixels, %zu layers in %zu fills", fill_.pixels / 1e6, fill_.layers, fill_.fills);
+  text_.draw(graphics, line, 0, y, Text::Alignment::Left);
+
+  y += 16;
+  std::snprintf(line, sizeof(line), "flocking 1/%u, particles %.0f%%", rs.slices, rs.detail * 100);
+  text_.draw(graphics, line, 0, y, Text::Alignment::Left);
+}
+
+void GameScreen::add_box(size_t count) {
   for (size_t i = 0; i < count; ++i) {
     const auto square = reg_.create();
-    const uint32_t c = hsl{hue(rng_), 1.0f, 0.5f};
-    const pos p = { (float)px(rng_), (float)py(rng_) };
-
-    reg_.emplace<Health>(square, 1);
-    reg_.emplace<Color>(square, c);
-    reg_.emplace<Position>(square, p);
-    reg_.emplace<Size>(square, size(rng_));
-    reg_.emplace<Collision>(square);
-    reg_.emplace<Velocity>(square, velocity(rng_));
-    reg_.emplace<Angle>(square, angle(rng_));
-    reg_.emplace<MaxVelocity>(square);
-    reg_.emplace<Flocking>(square);
-    reg_.emplace<StayInBounds>(square);
+    init_box(square);
   }
 }
 
-void GameScreen::explosion(Audio& audio, const pos p, uint32_t color) {
-  std::uniform_real_distribution<float> angle(0, 2 * M_PI);
-  std::uniform_real_distribution<float> velocity(1, 15);
-  std::uniform_real_distribution<float> lifetime(1.5f, 4.5f);
+GameScreen::Box GameScreen::roll_box() {
+  Box box;
+  box.color = hsl{rng_.uniform(0, 260), 1.0f, 0.5f};
+  box.p = { (float)rng_.uniform_int(0, kConfig.graphics.width), (float)rng_.uniform_int(0, kConfig.graphics.height) };
+  box.size = rng_.uniform_int(10, 20);
 
-  for (size_t i = 0; i < 500; ++i) {
-    const auto pt = reg_.create();
+  const float vel = rng_.uniform(1, 5);
+  box.v = pos::polar(vel, rng_.uniform(0, 2 * M_PI));
+  return box;
+}
 
-    reg_.emplace<Particle>(pt);
-    reg_.emplace<Timer>(pt, lifetime(rng_));
-    reg_.emplace<Position>(pt, p);
-    reg_.emplace<Color>(pt, color);
-    reg_.emplace<Velocity>(pt, velocity(rng_));
-    reg_.emplace<Angle>(pt, angle(rng_));
-    reg_.emplace<StayInBounds>(pt);
-  }
+void GameScreen::init_box(entt::entity square) {
+  const Box box = roll_box();
+
+  reg_.emplace<Health>(square, 1);
+  reg_.emplace<Color>(square, box.color);
+  reg_.emplace<Position>(square, box.p);
+  reg_.emplace<Size>(square, box.size);
+  reg_.emplace<Collision>(square);
+  reg_.emplace<Vector>(square, box.v);
+  reg_.emplace<TargetDir>(square, box.v);
+  reg_.emplace<Previous>(square, box.p, box.v);
+  reg_.emplace<MaxVelocity>(square);
+  reg_.emplace<Flocking>(square);
+  reg_.emplace<StayInBounds>(square);
+}
+
+// Same as init_box() but for a box that already has its components, so the
+// pools don't have to remove and re-add it.
+void GameScreen::respawn_box(entt::entity square) {
+  const Box box = roll_box();
+
+  reg_.get<Health>(square).health = 1;
+  reg_.get<Color>(square).color = box.color;
+  reg_.get<Position>(square).p = box.p;
+  reg_.get<Size>(square).size = box.size;
+  reg_.get<Vector>(square).v = box.v;
+  reg_.get<TargetDir>(square).target = box.v;
+  reg_.get<Previous>(square) = { box.p, box.v };
+}
+
+// Every random number for the burst is drawn in a batch up front, then speeds
+// and angles are turned into velocities in place.
+void GameScreen::explosion(const pos p, uint32_t color) {
+  const size_t count = (size_t)(kSparks * budget_.detail());
+  spark_life_.resize(count);
+  spark_x_.resize(count);
+  spark_y_.resize(count);
+
+  rng_.fill(spark_life_.data(), count, 1.5f, 4.5f);
+  rng_.fill(spark_x_.data(), count, 1, 15);
+  rng_.fill(spark_y_.data(), count, 0, 2 * M_PI);
+  polar_n(spark_x_.data(), spark_y_.data(), spark_x_.data(), spark_y_.data(), count);
+
+  size_t i = 0;
+  particles_.spawn(p, color, count, [&](pos& v, float& life) {
+    v = { spark_x_[i], spark_y_[i] };
+    life = spark_life_[i];
+    ++i;
+  });
+
+  play_sample(SoundEvents::explode);
+}
 
-  audio.play_sample("explode.wav");
+void GameScreen::play_sample(SoundEvents::Sample sample) {
+  sounds_.trigger(sample);
 }
 
-void GameScreen::user_input(const Input& input) {
+void GameScreen::user_input(const Controls& input) {
   auto view = reg_.view<const PlayerControl, Accelleration, Rotation>();
   for (auto e : view) {
     float& accel = view.get<Accelleration>(e).accel;
@@ -254,60 +977,75 @@ void GameScreen::user_input(const Input& input) {
   }
 }
 
-void GameScreen::collision(Audio& audio) {
+void GameScreen::collision() {
+  auto targets = reg_.view<const Collision, const Position, const Size, Health>();
+
+  // Boxes are bucketed by center, so queries have to reach out by half the
+  // biggest target to find everything that could overlap.
+  float reach = 0.0f;
+  collision_grid_.clear();
+  for (auto t : targets) {
+    collision_grid_.insert(t, targets.get<const Position>(t).p);
+    reach = std::max(reach, targets.get<const Size>(t).size / 2);
+  }
+  collision_grid_.build();
+
   auto players = reg_.view<const PlayerControl, const Position, const Size, Health>();
   for (auto player : players) {
     const rect player_rect = get_rect(players.get<const Position>(player).p, players.get<const Size>(player).size);
-    auto targets = reg_.view<const Collision, const Position, const Size>();
-    for (auto t : targets) {
-      if (player == t) continue;
+    collision_grid_.query(player_rect.expand(reach), [&](const SpatialGrid::Entry& t) {
+      if (player == t.e || commands_.destroyed(t.e)) return;
 
-      const rect r = get_rect(targets.get<const Position>(t).p, targets.get<const Size>(t).size);
+      const rect r = get_rect(t.p, targets.get<const Size>(t.e).size);
 
       if (r.intersect(player_rect)) {
         players.get<Health>(player).health--;
 
-        const auto flash = reg_.create();
-        reg_.emplace<Flash>(flash);
-        reg_.emplace<Timer>(flash, 0.2f);
-        reg_.emplace<Color>(flash, 0x77000033);
+        commands_.create([this](entt::entity flash) {
+          reg_.emplace<Flash>(flash);
+          reg_.emplace<Timer>(flash, 0.2f);
+          reg_.emplace<Color>(flash, 0x77000033);
+        });
 
-        reg_.destroy(t);
-        add_box();
-        audio.play_sample("hit.wav");
+        commands_.recycle(t.e, [this](entt::entity box) { respawn_box(box); });
+        play_sample(SoundEvents::hit);
       }
-    }
+    });
   }
 
   auto bullets = reg_.view<const Bullet, const Position>();
   for (auto b : bullets) {
     const pos p = bullets.get<const Position>(b).p;
-    auto targets = reg_.view<const Collision, const Position, const Size, Health>();
-    for (auto t : targets) {
-      if (t == bullets.get<const Bullet>(b).source) continue;
+    const entt::entity source = bullets.get<const Bullet>(b).source;
 
-      const rect r = get_rect(targets.get<const Position>(t).p, targets.get<const Size>(t).size);
+    entt::entity hit = entt::null;
+    collision_grid_.query(rect{ p.x, p.y, p.x, p.y }.expand(reach), [&](const SpatialGrid::Entry& t) {
+      if (hit != entt::null || t.e == source || commands_.destroyed(t.e)) return;
+      if (get_rect(t.p, targets.get<const Size>(t.e).size).contains(p)) hit = t.e;
+    });
 
-      if (r.contains(p)) {
-        targets.get<Health>(t).health--;
-        reg_.destroy(b);
-        break;
-      }
+    if (hit != entt::null) {
+      targets.get<Health>(hit).health--;
+      commands_.destroy(b);
     }
   }
 }
 
-void GameScreen::kill_dead(Audio& audio) {
+void GameScreen::kill_dead() {
   auto view = reg_.view<const Health, const Position, const Color>();
   for (const auto e : view) {
-    if (view.get<const Health>(e).health <= 0.0f) {
+    if (view.get<const Health>(e).health <= 0.0f && !commands_.destroyed(e)) {
       const uint32_t color = view.get<const Color>(e).color;
       const pos p = view.get<const Position>(e).p;
-      explosion(audio, p, color);
+      explosion(p, color);
       ++score_;
 
-      reg_.destroy(e);
-      add_box();
+      if (reg_.all_of<PlayerControl>(e)) {
+        commands_.destroy(e);
+        commands_.create([this](entt::entity box) { init_box(box); });
+      } else {
+        commands_.recycle(e, [this](entt::entity box) { respawn_box(box); });
+      }
     }
   }
 }
@@ -323,59 +1061,49 @@ namespace {
 void GameScreen::kill_oob() {
   auto view = reg_.view<const Position, const KillOffScreen>();
   for (const auto e : view) {
-    if (oob(view.get<const Position>(e).p)) reg_.destroy(e);
+    if (oob(view.get<const Position>(e).p)) commands_.destroy(e);
   }
 }
 
-void GameScreen::accelleration(float t) {
-  auto view = reg_.view<Velocity, const Accelleration>();
-  for (const auto e : view) {
-    float& vel = view.get<Velocity>(e).vel;
-    vel = (vel + view.get<const Accelleration>(e).accel * t) * 0.99;
+void GameScreen::remember() {
+  Pipeline<Remember>().run(movers(reg_));
+
+  auto turners = reg_.view<Previous, const Position, const Angle>();
+  for (const auto e : turners) {
+    turners.get<Previous>(e) = { turners.get<const Position>(e).p, pos::polar(1.0f, turners.get<const Angle>(e).angle) };
   }
 }
 
-void GameScreen::rotation(float t) {
-  auto view = reg_.view<Angle, const Rotation>();
-  for (const auto e : view) {
-    float& angle = view.get<Angle>(e).angle;
-    angle += view.get<const Rotation>(e).rot * t;
-  }
+void GameScreen::accelleration(float t) {
+  Pipeline<Accelerate>(t).run(reg_.view<Velocity, const Accelleration>());
 }
 
-void GameScreen::steering(float t) {
-  auto view = reg_.view<Angle, const TargetDir>();
-  for (const auto e : view) {
-    float& angle = view.get<Angle>(e).angle;
-    angle += std::clamp(view.get<const TargetDir>(e).target - angle, -t, t);
-  }
+void GameScreen::rotation(float t) {
+  Pipeline<Rotate>(t).run(reg_.view<Angle, const Rotation>());
 }
 
-void GameScreen::max_velocity() {
-  auto view = reg_.view<Velocity, const MaxVelocity>();
-  for (const auto e : view) {
-    float& vel = view.get<Velocity>(e).vel;
-    const float max = view.get<const MaxVelocity>(e).max;
-    if (vel > max) vel = max;
-  }
+void GameScreen::steering(float t) {
+  Pipeline<Steer>(t).run(boids(reg_));
 }
 
 void GameScreen::movement(float t) {
-  auto view = reg_.view<Position, const Velocity, const Angle>();
-  for (const auto e : view) {
-    pos& p = view.get<Position>(e).p;
-    const float vel = view.get<const Velocity>(e).vel;
-    const float angle = view.get<const Angle>(e).angle;
+  auto group = movers(reg_);
+  movers_.assign(group.begin(), group.end());
 
-    p += pos::polar(vel, angle);
+  const Move move(t);
+  pool_.parallel_for(movers_.size(), 4096, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) move(group, movers_[i]);
+  });
 
-    if (reg_.all_of<ScreenWrap>(e)) {
-      while (p.x < 0) p.x += kConfig.graphics.width;
-      while (p.x > kConfig.graphics.width) p.x -= kConfig.graphics.width;
-      while (p.y < 0) p.y += kConfig.graphics.height;
-      while (p.y > kConfig.graphics.height) p.y -= kConfig.graphics.height;
-    }
+  auto turners = reg_.view<Position, const Velocity, const Angle>();
+  for (const auto e : turners) {
+    turners.get<Position>(e).p += pos::polar(turners.get<const Velocity>(e).vel, turners.get<const Angle>(e).angle);
   }
+
+  // Wrapping is done after everything has moved so the loops above don't
+  // have to look for the tag on every entity.
+  auto wrapping = reg_.view<Position, const ScreenWrap>();
+  for (const auto e : wrapping) wrap(wrapping.get<Position>(e).p);
 }
 
 void GameScreen::expiring(float t) {
@@ -383,24 +1111,26 @@ void GameScreen::expiring(float t) {
   for (const auto e : view) {
     Timer& tm = view.get<Timer>(e);
     tm.elapsed += t;
-    if (tm.expire && tm.elapsed > tm.lifetime) reg_.destroy(e);
+    if (tm.expire && tm.elapsed > tm.lifetime) commands_.destroy(e);
   }
 }
 
-void GameScreen::bullet(Audio& audio, entt::entity source, const pos p, const float a, const float vel) {
-  const auto bullet = reg_.create();
-
-  reg_.emplace<Bullet>(bullet, source);
-  reg_.emplace<Position>(bullet, pos{p.x + 5 * std::cos(a), p.y + 5 * std::sin(a)});
-  reg_.emplace<Velocity>(bullet, vel);
-  reg_.emplace<MaxVelocity>(bullet, vel);
-  reg_.emplace<Angle>(bullet, a);
-  reg_.emplace<KillOffScreen>(bullet);
-
-  audio.play_sample("shot.wav");
+void GameScreen::bullet(entt::entity source, const pos p, const float a, const float vel) {
+  commands_.create([=](entt::entity bullet) {
+    const pos start {p.x + 5 * std::cos(a), p.y + 5 * std::sin(a)};
+    const pos v = pos::polar(vel, a);
+    reg_.emplace<Bullet>(bullet, source);
+    reg_.emplace<Position>(bullet, start);
+    reg_.emplace<Previous>(bullet, start, v);
+    reg_.emplace<Vector>(bullet, v);
+    reg_.emplace<MaxVelocity>(bullet, vel);
+    reg_.emplace<KillOffScreen>(bullet);
+  });
+
+  play_sample(SoundEvents::shot);
 }
 
-void GameScreen::firing(Audio& audio, float t) {
+void GameScreen::firing(float t) {
   auto view = reg_.view<Firing, const Position, const Angle, const Velocity>();
   for (const auto e : view) {
     Firing& gun = view.get<Firing>(e);
@@ -412,87 +1142,85 @@ void GameScreen::firing(Audio& audio, float t) {
       const float a = view.get<const Angle>(e).angle;
       const float vel = view.get<const Velocity>(e).vel + 5;
 
-      bullet(audio, e, p, a, vel);
+      bullet(e, p, a, vel);
     }
   }
 }
 
-void GameScreen::bombing(Audio& audio, float t) {
+void GameScreen::bombing(float t) {
   auto view = reg_.view<Bomb, const Position>();
   for (const auto e : view) {
     for (float a = 0; a < 2 * M_PI; a += M_PI / 10.0f) {
-      bullet(audio, e, view.get<const Position>(e).p, a, 15);
+      bullet(e, view.get<const Position>(e).p, a, 15);
     }
-    reg_.remove<Bomb>(e);
+    commands_.remove<Bomb>(e);
   }
 }
 
 void GameScreen::flocking() {
-  auto view = reg_.view<const Flocking, const Position, Velocity, const Angle>();
+  auto view = boids(reg_);
+
+  // Neighbors are seen as they were at the start of the pass so boids can be
+  // steered in parallel without racing on each other's velocity.
+  flock_.clear();
+  boids_.clear();
   for (const auto e : view) {
-    const pos boid = view.get<const Position>(e).p;
-    const float angle = view.get<const Angle>(e).angle;
-    float& vel = view.get<Velocity>(e).vel;
-
-    int count = 0;
-    pos center, flock, avoid;
-    pos v = pos::polar(vel, angle);
-
-    auto nearby = reg_.view<const Flocking, const Position, const Velocity, const Angle>();
-    for (const auto other : nearby) {
-      if (other == e) continue;
-
-      pos p = nearby.get<const Position>(other).p;
-      float d = p.dist2(boid);
-
-      // close enough to see
-      if (d < 75.0f * 75.0f) {
-        ++count;
-        center += p;
-        flock += pos::polar(nearby.get<const Velocity>(other).vel, nearby.get<const Angle>(other).angle);
-      }
+    flock_.add(view.get<Position>(e).p, view.get<Vector>(e).v);
+    boids_.push_back(e);
+  }
+  flock_.build();
 
-      // too close
-      if (d < 20.0f * 20.0f) avoid += boid - p;
-    }
+  bool seeking = false;
+  pos seek;
+  auto players = reg_.view<const PlayerControl, const Position>();
+  for (const auto p : players) {
+    seek = players.get<const Position>(p).p;
+    seeking = true;
+    break;
+  }
 
-    if (count == 0) {
-      auto players = reg_.view<const PlayerControl, const Position>();
-      for (const auto p : players) {
-        const pos seek = players.get<const Position>(p).p;
-        reg_.emplace_or_replace<TargetDir>(e, (seek - boid).angle());
-        break;
+  // Only one slice of the boids steers each frame when the frame budget is
+  // tight.  The rest keep easing toward their old targets.
+  const size_t slices = budget_.slices();
+  const size_t offset = slice_++ % slices;
+  const size_t count = boids_.size() > offset ? (boids_.size() - offset + slices - 1) / slices : 0;
+
+  pool_.parallel_for(count, 256, [&](size_t begin, size_t end) {
+    for (size_t j = begin; j < end; ++j) {
+      const size_t i = offset + j * slices;
+      const auto e = boids_[i];
+      const pos boid = view.get<Position>(e).p;
+      pos& v = view.get<Vector>(e).v;
+
+      const Flock::Sums s = flock_.sums(i);
+
+      if (s.count == 0) {
+        if (seeking) view.get<TargetDir>(e).target = seek - boid;
+      } else {
+        const pos center = s.center / s.count;
+        const pos flock = s.flock / s.count;
+
+        // head for v + delta but, as before, only take its speed right away
+        const pos delta = center * 0.005f + s.avoid * 0.05f + flock * 0.05f;
+        const pos target = v + delta;
+        const float len2 = v.mag2();
+
+        view.get<TargetDir>(e).target = target;
+        v = len2 > 0 ? v * std::sqrt(target.mag2() / len2) : target;
       }
-    } else {
-      center /= count;
-      flock /= count;
-
-      const pos delta = (center - boid) * 0.005f + avoid * 0.05f + flock * 0.05f;
-      v += delta;
-
-      reg_.emplace_or_replace<TargetDir>(e, v.angle());
-      vel = v.mag();
     }
-  }
+  });
 }
 
 void GameScreen::stay_in_bounds() {
-  const float buffer = 25.0f;
-
-  auto view = reg_.view<const StayInBounds, const Position, Velocity, Angle>();
+  auto view = reg_.view<const StayInBounds, const Position, Vector>();
   for (const auto e : view) {
     const pos p = view.get<const Position>(e).p;
-    float& vel = view.get<Velocity>(e).vel;
-    float& angle = view.get<Angle>(e).angle;
-
-    pos v = pos::polar(vel, angle);
-
-    if (p.x < buffer) v.x += 1.0f;
-    if (p.x > kConfig.graphics.width - buffer) v.x -= 1.0f;
-    if (p.y < buffer) v.y += 1.0f;
-    if (p.y > kConfig.graphics.height - buffer) v.y -= 1.0f;
+    pos& v = view.get<Vector>(e).v;
 
-    vel = v.mag();
-    angle = v.angle();
+    if (p.x < kBoundsBuffer) v.x += 1.0f;
+    if (p.x > kConfig.graphics.width - kBoundsBuffer) v.x -= 1.0f;
+    if (p.y < kBoundsBuffer) v.y += 1.0f;
+    if (p.y > kConfig.graphics.height - kBoundsBuffer) v.y -= 1.0f;
   }
 }
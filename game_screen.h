@@ -1,61 +1,237 @@
 #pragma once
 
-#include <random>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "entt/entity/registry.hpp"
 
 #include "screen.h"
 #include "text.h"
 
+#include "budget.h"
+#include "command_buffer.h"
+#include "compositor.h"
+#include "controls.h"
+#include "draw_batch.h"
+#include "flocking.h"
+#include "framebuffer.h"
 #include "geometry.h"
+#include "particles.h"
+#include "profiler.h"
+#include "render_state.h"
+#include "replay.h"
+#include "rng.h"
+#include "scheduler.h"
+#include "sound_events.h"
+#include "spatial_grid.h"
+#include "spsc_queue.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
 
 class GameScreen : public Screen {
   public:
 
+    // Peak load to size the registry's pools for, so play doesn't have to grow
+    // them.  Going over only costs the odd allocation.
+    struct Capacity {
+      size_t boxes = 0;  // 0 for Options::boxes
+      size_t bullets = 512;
+      size_t effects = 64;  // flashes and fades
+    };
+
+    // What the last frame drawn cost in fill rate.  Full-screen layers are
+    // flashes, fades and dimming, which are folded together into at most one
+    // fill under the scene and one over it.
+    struct Fill {
+      size_t pixels = 0;
+      size_t layers = 0, fills = 0;
+    };
+
+    struct Options {
+      unsigned int seed;
+      size_t boxes = 1000;
+      int player_health = 100;
+      size_t particles = 65536;
+      unsigned int threads = 0;  // 0 for one per core, always 1 on the web
+      float flock_theta = 0.0f;  // 0 for exact flocking, see Flock
+
+      // Milliseconds a tick should take, with flocking and particles cut back
+      // to stay under it.  0 to always do everything.
+      float budget = 0.0f;
+
+      // The simulation always advances in ticks of this many milliseconds,
+      // however long frames take.  Draws blend between the last two ticks.
+      unsigned int tick = 16;
+
+      // Run the ticks on their own thread instead of from update().
+      bool threaded = false;
+
+      Capacity capacity = {};
+
+      // Totals hardware counters for every profiled section where Linux
+      // allows it, see Profiler::count_hardware().  Only fully counts what
+      // the pool runs with threads at 1.
+      bool counters = false;
+
+      // Keeps every profiled section as a trace event for
+      // Profiler::write_trace(), see Profiler::trace().
+      bool trace = false;
+
+      // Logs the seed and every frame of input here so the session can be
+      // replayed.  Only replays exactly with no budget and threaded off.
+      std::string record = "";
+    };
+
     GameScreen();
+    explicit GameScreen(const Options& options);
+    ~GameScreen();
 
     bool update(const Input& input, Audio& audio, unsigned int elapsed) override;
     void draw(Graphics& graphics) const override;
 
+    // Draws the same frame as draw() into a software framebuffer, minus the
+    // text, for timing and comparing frames without a display.
+    void render(Framebuffer& framebuffer) const;
+
+    // Runs one frame of the systems without audio or graphics.  Sound effects
+    // triggered during the frame are queued and played by update().
+    void simulate(const Controls& input, unsigned int elapsed);
+
+    // Takes one frame of recorded input the way update() takes live input,
+    // without sound.
+    void replay(const Controls& controls, unsigned int elapsed);
+
+    // Hash of the state of the world, the same for any two runs that played
+    // out the same way.
+    uint64_t checksum() const;
+
+    const Profiler& profiler() const { return profiler_; }
+    const SoundEvents& sounds() const { return sounds_; }
+    const Fill& fill() const { return fill_; }
+
+    // Makes room for at least capacity in every pool and everything drawn
+    // from them.  Never shrinks them.  Not while the threaded simulation is
+    // running.
+    void reserve(const Capacity& capacity);
+
+    // Writes the whole world to a snapshot, see snapshot.h, or swaps it for
+    // one, so a heavy scene can be built once and loaded in milliseconds.
+    // Loading puts pools in a different order than they were saved in, so
+    // play from a snapshot repeats itself but needn't follow the game it was
+    // taken from.  Both return false while the threaded simulation is
+    // running, and a load that fails leaves the world as it was.
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
     std::string get_music_track() const override { return "bedtime.ogg"; }
 
   private:
 
     enum class state { playing, paused, won, lost };
 
+    struct Box {
+      uint32_t color;
+      pos p;
+      float size;
+      pos v;
+    };
+
     entt::registry reg_;
-    std::mt19937 rng_;
+    CommandBuffer commands_;
+    Rng rng_;
     Text text_;
+    Flock flock_;
+    FrameBudget budget_;
+    size_t slice_;
+    SpatialGrid collision_grid_;
+    ParticlePool particles_;
 
     state state_;
     int score_;
 
+    // what the systems triggered and the voices to start after this tick
+    SoundEvents sounds_;
+    std::vector<SoundEvents::Sample> samples_;
+
+    mutable Profiler profiler_;
+    mutable DrawBatch batch_;
+    mutable Fill fill_;
+    bool show_profile_;
+
+    ThreadPool pool_;
+    Scheduler scheduler_;
+
+    // scratch lists of entities for systems that split their views into chunks
+    std::vector<entt::entity> boids_, movers_;
+
+    // scratch arrays for the batch math kernels
+    mutable std::vector<float> lines_;
+    std::vector<float> spark_life_, spark_x_, spark_y_;
+
+    Capacity capacity_;
+
+    // fixed timestep
+    const unsigned int tick_;
+    unsigned int accumulator_;
+    std::atomic<uint32_t> held_, pressed_;
+    ReplayWriter recording_;
+
+    // threaded mode
+    const bool threaded_;
+    std::thread sim_;
+    std::atomic<bool> running_;
+    mutable TripleBuffer<RenderState> snapshots_;
+    SpscQueue<SoundEvents::Sample, 256> voices_;
+
+    mutable RenderState snapshot_;
+
+    void prepare();
+    void schedule();
+    void latch(const Controls& controls);
+    void advance(unsigned int elapsed, Audio* audio);
+    void step();
+    void run();
+
     void add_box(size_t count = 1);
-    void explosion(Audio& audio, const pos p, uint32_t color);
-    void bullet(Audio& audio, entt::entity source, const pos p, float a, float vel);
+    Box roll_box();
+    void init_box(entt::entity square);
+    void respawn_box(entt::entity square);
+    void explosion(const pos p, uint32_t color);
+    void bullet(entt::entity source, const pos p, float a, float vel);
 
-    void user_input(const Input& input);
+    void play_sample(SoundEvents::Sample sample);
+    void user_input(const Controls& input);
 
-    void collision(Audio& audio);
+    void collision();
+    void remember();
 
     void accelleration(float t);
     void rotation(float t);
     void steering(float t);
     void flocking();
     void stay_in_bounds();
-    void max_velocity();
     void movement(float t);
 
     void expiring(float t);
-    void firing(Audio& audio, float t);
-    void bombing(Audio& audio, float t);
+    void firing(float t);
+    void bombing(float t);
 
-    void kill_dead(Audio& audio);
+    void kill_dead();
     void kill_oob();
 
-    void draw_flash(Graphics& graphics) const;
-    void draw_particles(Graphics& graphics) const;
-    void draw_squares(Graphics& graphics) const;
-    void draw_bullets(Graphics& graphics) const;
-    void draw_overlay(Graphics& graphics) const;
+    void capture(RenderState& rs) const;
+
+    const RenderState& latest(float& alpha) const;
+    void compose(const RenderState& rs, float alpha, int width, int height) const;
+
+    void draw_flash(const RenderState& rs, int width, int height, DrawBatch& batch) const;
+    void draw_particles(const RenderState& rs, float alpha, DrawBatch& batch) const;
+    void draw_squares(const RenderState& rs, float alpha, DrawBatch& batch) const;
+    void draw_bullets(const RenderState& rs, float alpha, DrawBatch& batch) const;
+    void draw_overlay(const RenderState& rs, int width, int height, DrawBatch& batch) const;
+    void draw_text(const RenderState& rs, Graphics& graphics) const;
+    void draw_profile(const RenderState& rs, Graphics& graphics) const;
 };
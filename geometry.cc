@@ -0,0 +1,203 @@
+#include "geometry.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(__AVX2__)
+  struct simd {
+    using F = __m256;
+    using I = __m256i;
+    static constexpr size_t width = 8;
+
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F a) { _mm256_storeu_ps(p, a); }
+    static F set(float f) { return _mm256_set1_ps(f); }
+    static I iset(int i) { return _mm256_set1_epi32(i); }
+
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+
+    static F bit_and(F a, F b) { return _mm256_and_ps(a, b); }
+    static F bit_xor(F a, F b) { return _mm256_xor_ps(a, b); }
+    static F lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static F eq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static I to_int(F a) { return _mm256_cvttps_epi32(a); }
+    static F to_float(I a) { return _mm256_cvtepi32_ps(a); }
+    static F as_float(I a) { return _mm256_castsi256_ps(a); }
+    static I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I iand(I a, I b) { return _mm256_and_si256(a, b); }
+    static I iandnot(I a, I b) { return _mm256_andnot_si256(a, b); }
+    static I ieq(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+    static I shift29(I a) { return _mm256_slli_epi32(a, 29); }
+  };
+#elif defined(__SSE2__)
+  struct simd {
+    using F = __m128;
+    using I = __m128i;
+    static constexpr size_t width = 4;
+
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F a) { _mm_storeu_ps(p, a); }
+    static F set(float f) { return _mm_set1_ps(f); }
+    static I iset(int i) { return _mm_set1_epi32(i); }
+
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+
+    static F bit_and(F a, F b) { return _mm_and_ps(a, b); }
+    static F bit_xor(F a, F b) { return _mm_xor_ps(a, b); }
+    static F lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static F eq(F a, F b) { return _mm_cmpeq_ps(a, b); }
+    static F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+    static I to_int(F a) { return _mm_cvttps_epi32(a); }
+    static F to_float(I a) { return _mm_cvtepi32_ps(a); }
+    static F as_float(I a) { return _mm_castsi128_ps(a); }
+    static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+    static I iand(I a, I b) { return _mm_and_si128(a, b); }
+    static I iandnot(I a, I b) { return _mm_andnot_si128(a, b); }
+    static I ieq(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+    static I shift29(I a) { return _mm_slli_epi32(a, 29); }
+  };
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  using F = simd::F;
+  using I = simd::I;
+
+  F sign_bits(F a) { return simd::bit_and(a, simd::as_float(simd::iset(0x80000000))); }
+  F abs_v(F a) { return simd::bit_and(a, simd::as_float(simd::iset(0x7fffffff))); }
+
+  // Cephes style sincos: reduce to [-pi/4, pi/4] by octant then pick the sine
+  // or cosine polynomial for each lane.  Good to a couple of ulps for the
+  // angles the game deals with.
+  void sincos_v(F x, F& s, F& c) {
+    F sign_sin = sign_bits(x);
+    x = abs_v(x);
+
+    I j = simd::to_int(simd::mul(x, simd::set(4.0f / (float)M_PI)));
+    j = simd::iand(simd::iadd(j, simd::iset(1)), simd::iset(~1));
+    const F y = simd::to_float(j);
+
+    const F swap_sin = simd::as_float(simd::shift29(simd::iand(j, simd::iset(4))));
+    const F swap_cos = simd::as_float(simd::shift29(simd::iandnot(simd::iadd(j, simd::iset(-2)), simd::iset(4))));
+    const F use_sin = simd::as_float(simd::ieq(simd::iand(j, simd::iset(2)), simd::iset(0)));
+    sign_sin = simd::bit_xor(sign_sin, swap_sin);
+
+    x = simd::add(x, simd::mul(y, simd::set(-0.78515625f)));
+    x = simd::add(x, simd::mul(y, simd::set(-2.4187564849853515625e-4f)));
+    x = simd::add(x, simd::mul(y, simd::set(-3.77489497744594108e-8f)));
+    const F z = simd::mul(x, x);
+
+    F pc = simd::set(2.443315711809948e-5f);
+    pc = simd::add(simd::mul(pc, z), simd::set(-1.388731625493765e-3f));
+    pc = simd::add(simd::mul(pc, z), simd::set(4.166664568298827e-2f));
+    pc = simd::mul(simd::mul(pc, z), z);
+    pc = simd::sub(pc, simd::mul(z, simd::set(0.5f)));
+    pc = simd::add(pc, simd::set(1.0f));
+
+    F ps = simd::set(-1.9515295891e-4f);
+    ps = simd::add(simd::mul(ps, z), simd::set(8.3321608736e-3f));
+    ps = simd::add(simd::mul(ps, z), simd::set(-1.6666654611e-1f));
+    ps = simd::add(simd::mul(simd::mul(ps, z), x), x);
+
+    s = simd::bit_xor(simd::select(use_sin, ps, pc), sign_sin);
+    c = simd::bit_xor(simd::select(use_sin, pc, ps), swap_cos);
+  }
+
+  // Folds the angle into the first octant, evaluates the Cephes atanf
+  // polynomial and unfolds by quadrant.
+  F atan2_v(F y, F x) {
+    const F ax = abs_v(x);
+    const F ay = abs_v(y);
+    const F lo = simd::min(ax, ay);
+    const F hi = simd::max(ax, ay);
+    const F zero = simd::set(0.0f);
+
+    F t = simd::select(simd::eq(hi, zero), zero, simd::div(lo, hi));
+
+    // past tan(pi/8) use atan(t) = pi/4 + atan((t - 1) / (t + 1))
+    const F big = simd::lt(simd::set(0.41421356f), t);
+    t = simd::select(big, simd::div(simd::sub(t, simd::set(1.0f)), simd::add(t, simd::set(1.0f))), t);
+
+    const F z = simd::mul(t, t);
+    F r = simd::set(8.05374449538e-2f);
+    r = simd::add(simd::mul(r, z), simd::set(-1.38776856032e-1f));
+    r = simd::add(simd::mul(r, z), simd::set(1.99777106478e-1f));
+    r = simd::add(simd::mul(r, z), simd::set(-3.33329491539e-1f));
+    r = simd::add(simd::mul(simd::mul(r, z), t), t);
+    r = simd::add(r, simd::bit_and(big, simd::set((float)M_PI / 4)));
+
+    r = simd::select(simd::lt(ax, ay), simd::sub(simd::set((float)M_PI / 2), r), r);
+    r = simd::select(simd::lt(x, zero), simd::sub(simd::set((float)M_PI), r), r);
+    return simd::bit_xor(r, sign_bits(y));
+  }
+
+  // Runs f over whole vectors, then once more over a zero padded copy of
+  // whatever is left so the tail gets exactly the same math.
+  template <size_t In, size_t Out, typename Fn>
+  void each_vector(const float* const (&in)[In], float* const (&out)[Out], size_t n, Fn&& f) {
+    F a[In], b[Out];
+    size_t i = 0;
+    for (; i + simd::width <= n; i += simd::width) {
+      for (size_t k = 0; k < In; ++k) a[k] = simd::load(in[k] + i);
+      f(a, b);
+      for (size_t k = 0; k < Out; ++k) simd::store(out[k] + i, b[k]);
+    }
+
+    if (i == n) return;
+
+    float pad[simd::width] = {};
+    const size_t rest = n - i;
+    for (size_t k = 0; k < In; ++k) {
+      std::copy(in[k] + i, in[k] + n, pad);
+      a[k] = simd::load(pad);
+    }
+    f(a, b);
+    for (size_t k = 0; k < Out; ++k) {
+      simd::store(pad, b[k]);
+      std::copy(pad, pad + rest, out[k] + i);
+    }
+  }
+#endif
+}
+
+void polar_n(const float* r, const float* theta, float* x, float* y, size_t n) {
+#if defined(__AVX2__) || defined(__SSE2__)
+  each_vector<2, 2>({ r, theta }, { x, y }, n, [](const F* in, F* out) {
+    F s, c;
+    sincos_v(in[1], s, c);
+    out[0] = simd::mul(in[0], c);
+    out[1] = simd::mul(in[0], s);
+  });
+#else
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = r[i] * std::cos(theta[i]);
+    y[i] = r[i] * std::sin(theta[i]);
+  }
+#endif
+}
+
+void atan2_n(const float* y, const float* x, float* out, size_t n) {
+#if defined(__AVX2__) || defined(__SSE2__)
+  each_vector<2, 1>({ y, x }, { out }, n, [](const F* in, F* result) {
+    result[0] = atan2_v(in[0], in[1]);
+  });
+#else
+  for (size_t i = 0; i < n; ++i) out[i] = std::atan2(y[i], x[i]);
+#endif
+}
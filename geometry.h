@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
 struct polar;
 
 struct pos {
@@ -18,6 +23,10 @@ struct pos {
   constexpr bool operator==(const pos other) const { return x == other.x && y == other.y; }
   constexpr bool operator!=(const pos other) const { return x != other.x || y != other.y; }
 
+  constexpr float dot(const pos other) const { return x * other.x + y * other.y; }
+  constexpr float cross(const pos other) const { return x * other.y - y * other.x; }
+  constexpr float mag2() const { return x * x + y * y; }
+
   constexpr float dist2(const pos other) const {
     const float dx = x - other.x;
     const float dy = y - other.y;
@@ -47,8 +56,29 @@ struct rect {
   constexpr bool contains(const pos p) const {
     return left < p.x && right > p.x && top < p.y && bottom > p.y;
   };
+
+  constexpr rect expand(float n) const { return { left - n, top - n, right + n, bottom + n }; }
 };
 
+constexpr rect get_rect(const pos& p, float size) {
+  return { p.x - size / 2, p.y - size / 2, p.x + size / 2, p.y + size / 2 };
+}
+
+constexpr pos lerp(const pos a, const pos b, float t) {
+  return a + (b - a) * t;
+}
+
+// Blends angles the short way around the circle.
+inline float lerp_angle(float a, float b, float t) {
+  return a + std::remainder(b - a, 2 * (float)M_PI) * t;
+}
+
+// Batch versions of pos::polar and pos::angle over parallel arrays,
+// using SSE2 or AVX2 when built for them.  Results are within a few ulps of
+// the std functions.  Outputs may alias inputs.
+void polar_n(const float* r, const float* theta, float* x, float* y, size_t n);
+void atan2_n(const float* y, const float* x, float* out, size_t n);
+
 namespace {
   constexpr uint32_t make_color(float r, float g, float b) {
     return
@@ -1,7 +1,10 @@
+#include <cstring>
+
 #include "game.h"
 
 #include "config.h"
 #include "game_screen.h"
+#include "util.h"
 
 #ifdef __EMSCRIPTEN__
 #include "emscripten.h"
@@ -11,9 +14,22 @@ void step(void* game) {
 }
 #endif
 
-int main(int, char**) {
+int main(int argc, char** argv) {
+  GameScreen::Options options { Util::random_seed() };
+  options.budget = 10.0f;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--threaded") == 0) options.threaded = true;
+    if (std::strncmp(argv[i], "--record=", 9) == 0) options.record = argv[i] + 9;
+  }
+
+  // A recording only plays back the same when every tick does the same work.
+  if (!options.record.empty()) {
+    options.budget = 0.0f;
+    options.threaded = false;
+  }
+
   Game game(kConfig);
-  Screen *start = new GameScreen();
+  Screen *start = new GameScreen(options);
 
 #ifdef __EMSCRIPTEN__
   game.start(start);
@@ -0,0 +1,70 @@
+#include "particles.h"
+
+#include <cstring>
+
+ParticlePool::ParticlePool(size_t capacity, const rect bounds) :
+  bounds_(bounds), size_(0),
+  x_(capacity), y_(capacity), px_(capacity), py_(capacity), vx_(capacity), vy_(capacity), age_(capacity), lifetime_(capacity),
+  color_(capacity) {}
+
+void ParticlePool::update(float t) {
+  size_t i = 0;
+  while (i < size_) {
+    age_[i] += t;
+    if (age_[i] > lifetime_[i]) {
+      remove(i);
+      continue;
+    }
+
+    if (x_[i] < bounds_.left) vx_[i] += 1.0f;
+    if (x_[i] > bounds_.right) vx_[i] -= 1.0f;
+    if (y_[i] < bounds_.top) vy_[i] += 1.0f;
+    if (y_[i] > bounds_.bottom) vy_[i] -= 1.0f;
+
+    px_[i] = x_[i];
+    py_[i] = y_[i];
+    x_[i] += vx_[i];
+    y_[i] += vy_[i];
+    ++i;
+  }
+}
+
+void ParticlePool::age(float t) {
+  size_t i = 0;
+  while (i < size_) {
+    age_[i] += t;
+    if (age_[i] > lifetime_[i]) {
+      remove(i);
+    } else {
+      px_[i] = x_[i];
+      py_[i] = y_[i];
+      ++i;
+    }
+  }
+}
+
+void ParticlePool::remove(size_t i) {
+  const size_t last = --size_;
+  x_[i] = x_[last];
+  y_[i] = y_[last];
+  px_[i] = px_[last];
+  py_[i] = py_[last];
+  vx_[i] = vx_[last];
+  vy_[i] = vy_[last];
+  age_[i] = age_[last];
+  lifetime_[i] = lifetime_[last];
+  color_[i] = color_[last];
+}
+
+const void* ParticlePool::column(size_t c) const {
+  const void* const columns[kColumns] = {
+    x_.data(), y_.data(), px_.data(), py_.data(), vx_.data(), vy_.data(), age_.data(), lifetime_.data(), color_.data() };
+  return c < kColumns ? columns[c] : nullptr;
+}
+
+void ParticlePool::restore(size_t n, const void* const columns[kColumns]) {
+  void* const to[kColumns] = {
+    x_.data(), y_.data(), px_.data(), py_.data(), vx_.data(), vy_.data(), age_.data(), lifetime_.data(), color_.data() };
+  size_ = std::min(n, capacity());
+  for (size_t c = 0; c < kColumns; ++c) std::memcpy(to[c], columns[c], size_ * sizeof(float));
+}
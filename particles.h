@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+// Fixed capacity pool of explosion particles stored as parallel arrays so the
+// per-frame update is one linear pass.  Expired particles are swapped with the
+// last live one, keeping the live range packed at the front.
+class ParticlePool {
+  public:
+
+    // Particles are nudged back toward the inside of bounds like StayInBounds.
+    ParticlePool(size_t capacity, const rect bounds);
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return x_.size(); }
+
+    // Adds up to count particles at p.  init(velocity, lifetime) is called once
+    // for each one to fill in its motion.  Particles that don't fit are dropped.
+    template <typename F>
+    void spawn(const pos p, uint32_t color, size_t count, F&& init) {
+      const size_t end = std::min(size_ + count, capacity());
+      for (size_t i = size_; i < end; ++i) {
+        pos v;
+        init(v, lifetime_[i]);
+
+        x_[i] = px_[i] = p.x;
+        y_[i] = py_[i] = p.y;
+        vx_[i] = v.x;
+        vy_[i] = v.y;
+        age_[i] = 0.0f;
+        color_[i] = color;
+      }
+      size_ = end;
+    }
+
+    // Ages, expires and moves every particle.
+    void update(float t);
+
+    // Ages and expires particles without moving them, for when the game is paused.
+    void age(float t);
+
+    void clear() { size_ = 0; }
+
+    // The live particles a column at a time, for saving: position, previous
+    // position, velocity, age, lifetime and color, all four bytes each.
+    static constexpr size_t kColumns = 9;
+    const void* column(size_t c) const;
+
+    // Replaces every particle with n from columns laid out like column(),
+    // dropping any that don't fit.
+    void restore(size_t n, const void* const columns[kColumns]);
+
+    // Calls f(previous, position, color, ratio) for each live particle, where
+    // previous is where it was before the last update and ratio is how far
+    // through its lifetime it is.
+    template <typename F>
+    void each(F&& f) const {
+      for (size_t i = 0; i < size_; ++i) {
+        f(pos{ px_[i], py_[i] }, pos{ x_[i], y_[i] }, color_[i], age_[i] / lifetime_[i]);
+      }
+    }
+
+  private:
+
+    rect bounds_;
+    size_t size_;
+
+    std::vector<float> x_, y_, px_, py_, vx_, vy_, age_, lifetime_;
+    std::vector<uint32_t> color_;
+
+    void remove(size_t i);
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+
+#include "entt/entity/registry.hpp"
+
+#include "scheduler.h"
+
+// Per-entity systems fused into a single pass.  A kernel is a small struct
+// whose call operator takes references to the components it works on, const
+// for the ones it only reads:
+//
+//   struct Translate {
+//     void operator()(Position& p, const Vector& v) const { p.p += v.v; }
+//   };
+//
+// Kernels that need the tick length take it in their constructor, once per
+// pass.  A Pipeline runs every kernel on one entity before moving on to the
+// next, which does the same as running them one pass at a time in order as
+// long as no kernel looks at any other entity.  Every component a kernel
+// takes must be available from the view or group the pipeline runs over.
+template <typename... Kernels>
+class Pipeline {
+  private:
+
+    template <typename F> struct signature;
+
+    template <typename K, typename... C>
+    struct signature<void (K::*)(C&...) const> {
+      using reads = decltype(std::tuple_cat(std::declval<
+            std::conditional_t<std::is_const_v<C>, std::tuple<std::remove_const_t<C>>, std::tuple<>>>()...));
+      using writes = decltype(std::tuple_cat(std::declval<
+            std::conditional_t<std::is_const_v<C>, std::tuple<>, std::tuple<C>>>()...));
+
+      template <typename View>
+      static void call(const K& kernel, View& view, entt::entity e) {
+        kernel(view.template get<std::remove_const_t<C>>(e)...);
+      }
+    };
+
+    template <typename K>
+    using signature_of = signature<decltype(&K::operator())>;
+
+    template <template <typename...> class To, typename Tuple> struct rebind;
+
+    template <template <typename...> class To, typename... T>
+    struct rebind<To, std::tuple<T...>> { using type = To<T...>; };
+
+    template <typename K>
+    static K make(float t) {
+      if constexpr (std::is_constructible_v<K, float>) {
+        return K(t);
+      } else {
+        return K{};
+      }
+    }
+
+  public:
+
+    // everything the kernels read and write, for Scheduler::add()
+    using reads = typename rebind<Reads, decltype(std::tuple_cat(std::declval<typename signature_of<Kernels>::reads>()...))>::type;
+    using writes = typename rebind<Writes, decltype(std::tuple_cat(std::declval<typename signature_of<Kernels>::writes>()...))>::type;
+
+    explicit Pipeline(float t = 0.0f) : kernels_(make<Kernels>(t)...) {}
+
+    template <typename View>
+    void operator()(View& view, entt::entity e) const {
+      std::apply([&](const Kernels&... kernel) { (signature_of<Kernels>::call(kernel, view, e), ...); }, kernels_);
+    }
+
+    template <typename View>
+    void run(View view) const {
+      for (const auto e : view) (*this)(view, e);
+    }
+
+  private:
+
+    std::tuple<Kernels...> kernels_;
+};
@@ -0,0 +1,124 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+Profiler::Profiler() : epoch_(clock::now()), counting_(false), tracing_(false) {}
+
+void Profiler::trace() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.reserve(kMaxEvents);
+  tracing_ = true;
+}
+
+bool Profiler::count_hardware() {
+  counting_ = Counters::available();
+  return counting_;
+}
+
+void Profiler::record(const char* name, clock::time_point start, clock::time_point end) {
+  using micros = std::chrono::duration<double, std::micro>;
+
+  const float duration = (float)micros(end - start).count();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t i = section(name);
+  const size_t thread = thread_index(std::this_thread::get_id());
+
+  Section& s = sections_[i];
+  s.samples[s.count % kWindow] = duration / 1000.0f;
+  ++s.count;
+
+  if (tracing_ && events_.size() < kMaxEvents) events_.push_back({ i, micros(start - epoch_).count(), duration, thread });
+}
+
+void Profiler::count(const char* name, const Counters::Sample& before, const Counters::Sample& after) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Section& s = sections_[section(name)];
+  for (size_t e = 0; e < Counters::kEvents; ++e) s.totals[e] += after[e] - before[e];
+  ++s.counted;
+}
+
+std::vector<Profiler::Stats> Profiler::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<Stats> stats;
+  stats.reserve(sections_.size());
+
+  for (const auto& s : sections_) {
+    const size_t n = std::min(s.count, kWindow);
+    std::array<float, kWindow> sorted = s.samples;
+    std::sort(sorted.begin(), sorted.begin() + n);
+
+    float total = 0;
+    for (size_t i = 0; i < n; ++i) total += sorted[i];
+
+    const size_t p99 = (size_t)std::ceil(0.99f * n);
+    stats.push_back({ s.name, sorted[0], total / n, sorted[std::max(p99, (size_t)1) - 1] });
+  }
+
+  return stats;
+}
+
+std::vector<Profiler::Counts> Profiler::counts() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<Counts> counts;
+  counts.reserve(sections_.size());
+  for (const auto& s : sections_) counts.push_back({ s.name, s.counted, s.totals });
+  return counts;
+}
+
+bool Profiler::write_csv(const std::string& path) const {
+  std::ofstream out(path);
+  if (!out) return false;
+
+  out << std::fixed << std::setprecision(4);
+  out << "section,min_ms,avg_ms,p99_ms\n";
+  for (const auto& s : stats()) {
+    out << s.name << "," << s.min << "," << s.avg << "," << s.p99 << "\n";
+  }
+
+  return out.good();
+}
+
+// Chrome trace event format, which chrome://tracing and Perfetto can load.
+bool Profiler::write_trace(const std::string& path) const {
+  std::ofstream out(path);
+  if (!out) return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[\n";
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const Event& e = events_[i];
+    out << (i > 0 ? ",\n" : "")
+      << "{\"name\":\"" << sections_[e.section].name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+      << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << "}";
+  }
+  out << "\n]}\n";
+
+  return out.good();
+}
+
+size_t Profiler::section(const char* name) {
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    if (sections_[i].name == name || std::strcmp(sections_[i].name, name) == 0) return i;
+  }
+
+  sections_.push_back({ name, {}, 0 });
+  return sections_.size() - 1;
+}
+
+size_t Profiler::thread_index(std::thread::id id) {
+  const auto it = std::find(threads_.begin(), threads_.end(), id);
+  if (it != threads_.end()) return it - threads_.begin();
+
+  threads_.push_back(id);
+  return threads_.size() - 1;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "counters.h"
+
+// Wall clock timings for named sections of the frame.  Each section keeps a
+// rolling window of recent samples for the overlay.  Once trace() is called
+// every sample is also kept as a trace event so whole runs can be dumped and
+// compared offline.  Sections can be recorded from any thread.
+//
+// Hardware counters can be totalled per section too.  They only follow the
+// thread a section ran on, so work it hands to the pool goes uncounted.
+class Profiler {
+  public:
+
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t kWindow = 120;
+    static constexpr size_t kMaxEvents = 1 << 20;
+
+    struct Stats {
+      const char* name;
+      float min, avg, p99;  // milliseconds
+    };
+
+    // counter totals over every sample since counting started
+    struct Counts {
+      const char* name;
+      size_t samples;
+      Counters::Sample totals;
+    };
+
+    class Scope {
+      public:
+        Scope(Profiler& profiler, const char* name) :
+          profiler_(profiler), name_(name),
+          counts_(profiler.counting_ ? Counters::read() : Counters::Sample{}),
+          start_(clock::now()) {}
+
+        ~Scope() {
+          profiler_.record(name_, start_, clock::now());
+          if (profiler_.counting_) profiler_.count(name_, counts_, Counters::read());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Profiler& profiler_;
+        const char* name_;
+        Counters::Sample counts_;
+        clock::time_point start_;
+    };
+
+    Profiler();
+
+    template <typename F>
+    void time(const char* name, F&& f) {
+      Scope scope(*this, name);
+      f();
+    }
+
+    void record(const char* name, clock::time_point start, clock::time_point end);
+
+    // Starts keeping trace events for write_trace(), with room for
+    // kMaxEvents made now so recording never allocates.  Any past that are
+    // dropped.
+    void trace();
+    bool tracing() const { return tracing_; }
+
+    // Starts reading hardware counters around every section, if the calling
+    // thread can.  Call before recording anything.
+    bool count_hardware();
+    bool counting() const { return counting_; }
+
+    // Stats for every section in the order they were first recorded.
+    std::vector<Stats> stats() const;
+    std::vector<Counts> counts() const;
+
+    bool write_csv(const std::string& path) const;
+    bool write_trace(const std::string& path) const;
+
+  private:
+
+    struct Section {
+      const char* name;
+      std::array<float, kWindow> samples;
+      size_t count = 0;
+
+      Counters::Sample totals {};
+      size_t counted = 0;
+    };
+
+    struct Event {
+      size_t section;
+      double start;  // microseconds since the profiler was created
+      float duration;  // microseconds
+      size_t thread;
+    };
+
+    clock::time_point epoch_;
+    bool counting_;
+    bool tracing_;
+    mutable std::mutex mutex_;
+    std::vector<Section> sections_;
+    std::vector<Event> events_;
+    std::vector<std::thread::id> threads_;
+
+    size_t section(const char* name);
+    void count(const char* name, const Counters::Sample& before, const Counters::Sample& after);
+    size_t thread_index(std::thread::id id);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+// Everything draw() needs from one frame of the simulation, copied out of the
+// registry so it can be drawn while the next frame is being simulated.  Colors
+// already have any fading applied.  Moving things carry where they were at
+// the end of the previous tick as well so draws can blend between the two.
+struct RenderState {
+  struct Square {
+    pos prev, p;
+    pos prev_heading, heading;  // any length
+    float size;
+    uint32_t color;
+    bool filled;
+  };
+
+  struct Particle {
+    pos prev, p;
+    uint32_t color;
+  };
+
+  struct Bullet {
+    pos prev, p;
+  };
+
+  struct Player {
+    uint32_t color;
+    float health;
+  };
+
+  // Every full-screen layer folded into one color, 0 for none.  The flash is
+  // opaque and goes under everything, the overlay over everything.  layers
+  // counts how many went into the two.
+  uint32_t flash = 0, overlay = 0;
+  size_t layers = 0;
+
+  std::vector<Particle> particles;
+  std::vector<Square> squares;
+  std::vector<Bullet> bullets;
+  std::vector<Player> players;
+
+  int score = 0;
+  bool paused = false, lost = false;
+  bool show_profile = false;
+  unsigned int slices = 1;
+  float detail = 1.0f;
+
+  // when the tick this was captured from finished
+  std::chrono::steady_clock::time_point time;
+
+  void reserve(size_t particle_count, size_t square_count, size_t bullet_count) {
+    particles.reserve(particle_count);
+    squares.reserve(square_count);
+    bullets.reserve(bullet_count);
+    players.reserve(1);
+  }
+
+  // Empties everything but keeps the allocations for the next frame.
+  void clear() {
+    flash = overlay = 0;
+    layers = 0;
+    particles.clear();
+    squares.clear();
+    bullets.clear();
+    players.clear();
+  }
+};
@@ -0,0 +1,73 @@
+#include "replay.h"
+
+#include <algorithm>
+
+namespace {
+  constexpr char kMagic[4] = { 'S', 'Q', 'Z', 'R' };
+  constexpr uint64_t kVersion = 1;
+}
+
+bool ReplayWriter::open(const std::string& path, const ReplayHeader& header) {
+  out_.open(path, std::ios::binary | std::ios::trunc);
+  if (!out_) return false;
+
+  out_.write(kMagic, sizeof(kMagic));
+  varint(kVersion);
+  varint(header.seed);
+  varint(header.tick);
+  varint(header.boxes);
+  return out_.good();
+}
+
+void ReplayWriter::write(unsigned int elapsed, const Controls& controls) {
+  varint(elapsed);
+  varint(controls.held);
+  varint(controls.pressed);
+}
+
+void ReplayWriter::varint(uint64_t n) {
+  while (n >= 0x80) {
+    out_.put((char)(n | 0x80));
+    n >>= 7;
+  }
+  out_.put((char)n);
+}
+
+bool ReplayReader::open(const std::string& path) {
+  in_.open(path, std::ios::binary);
+  if (!in_) return false;
+
+  char magic[sizeof(kMagic)];
+  if (!in_.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), kMagic)) return false;
+
+  uint64_t version, seed, tick, boxes;
+  if (!varint(version) || version != kVersion) return false;
+  if (!varint(seed) || !varint(tick) || !varint(boxes)) return false;
+
+  header_.seed = (unsigned int)seed;
+  header_.tick = (unsigned int)tick;
+  header_.boxes = boxes;
+  return true;
+}
+
+bool ReplayReader::read(unsigned int& elapsed, Controls& controls) {
+  uint64_t e, held, pressed;
+  if (!varint(e) || !varint(held) || !varint(pressed)) return false;
+
+  elapsed = (unsigned int)e;
+  controls.held = (uint32_t)held;
+  controls.pressed = (uint32_t)pressed;
+  return true;
+}
+
+bool ReplayReader::varint(uint64_t& n) {
+  n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const int c = in_.get();
+    if (c == std::char_traits<char>::eof()) return false;
+
+    n |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
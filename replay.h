@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "controls.h"
+
+// Compact binary log of a session for playing it back exactly: a header with
+// everything that shapes the simulation, then one record per frame of how
+// long it took and which buttons were down.  Numbers are written as LEB128
+// varints so a typical frame takes three bytes.
+
+struct ReplayHeader {
+  unsigned int seed = 0;
+  unsigned int tick = 16;
+  uint64_t boxes = 0;
+};
+
+class ReplayWriter {
+  public:
+
+    bool open(const std::string& path, const ReplayHeader& header);
+    bool is_open() const { return out_.is_open(); }
+
+    void write(unsigned int elapsed, const Controls& controls);
+
+  private:
+
+    std::ofstream out_;
+
+    void varint(uint64_t n);
+};
+
+class ReplayReader {
+  public:
+
+    // False if the file is missing or isn't a replay this build understands.
+    bool open(const std::string& path);
+    const ReplayHeader& header() const { return header_; }
+
+    // False once the log runs out.
+    bool read(unsigned int& elapsed, Controls& controls);
+
+  private:
+
+    std::ifstream in_;
+    ReplayHeader header_;
+
+    bool varint(uint64_t& n);
+};
@@ -0,0 +1,208 @@
+#include "rng.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  constexpr uint32_t kM0 = 0xD2511F53, kM1 = 0xCD9E8D57;
+  constexpr uint32_t kW0 = 0x9E3779B9, kW1 = 0xBB67AE85;
+  constexpr int kRounds = 10;
+
+  void mulhilo(uint32_t a, uint32_t b, uint32_t& lo, uint32_t& hi) {
+    const uint64_t p = (uint64_t)a * b;
+    lo = (uint32_t)p;
+    hi = (uint32_t)(p >> 32);
+  }
+
+  // 24 random bits scaled into [lo, hi).  Fused where the SIMD version can be
+  // too so both give the same floats.
+  float scale(uint32_t x, float lo, float span) {
+    const float u = (float)(x >> 8) * 0x1p-24f;
+#if defined(__FMA__)
+    return std::fma(span, u, lo);
+#else
+    return lo + span * u;
+#endif
+  }
+
+#if defined(__AVX2__)
+  using lanes = __m256i;
+  using flanes = __m256;
+  constexpr size_t kWidth = 8;
+  lanes set(uint32_t i) { return _mm256_set1_epi32((int)i); }
+  lanes add(lanes a, lanes b) { return _mm256_add_epi32(a, b); }
+  lanes bit_xor(lanes a, lanes b) { return _mm256_xor_si256(a, b); }
+  lanes bit_or(lanes a, lanes b) { return _mm256_or_si256(a, b); }
+  lanes bit_and(lanes a, lanes b) { return _mm256_and_si256(a, b); }
+  lanes bit_andnot(lanes a, lanes b) { return _mm256_andnot_si256(a, b); }
+  lanes mul_even(lanes a, lanes b) { return _mm256_mul_epu32(a, b); }
+  lanes shift_left64(lanes a) { return _mm256_slli_epi64(a, 32); }
+  lanes shift_right64(lanes a) { return _mm256_srli_epi64(a, 32); }
+  lanes low_mask() { return _mm256_set1_epi64x(0xffffffff); }
+  lanes iota() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+  flanes to_unit(lanes x) {
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(0x1p-24f));
+  }
+  flanes fset(float f) { return _mm256_set1_ps(f); }
+#if defined(__FMA__)
+  flanes scale(flanes u, flanes lo, flanes span) { return _mm256_fmadd_ps(span, u, lo); }
+#else
+  flanes scale(flanes u, flanes lo, flanes span) { return _mm256_add_ps(lo, _mm256_mul_ps(span, u)); }
+#endif
+  void store(float* p, flanes a) { _mm256_storeu_ps(p, a); }
+#elif defined(__SSE2__)
+  using lanes = __m128i;
+  using flanes = __m128;
+  constexpr size_t kWidth = 4;
+  lanes set(uint32_t i) { return _mm_set1_epi32((int)i); }
+  lanes add(lanes a, lanes b) { return _mm_add_epi32(a, b); }
+  lanes bit_xor(lanes a, lanes b) { return _mm_xor_si128(a, b); }
+  lanes bit_or(lanes a, lanes b) { return _mm_or_si128(a, b); }
+  lanes bit_and(lanes a, lanes b) { return _mm_and_si128(a, b); }
+  lanes bit_andnot(lanes a, lanes b) { return _mm_andnot_si128(a, b); }
+  lanes mul_even(lanes a, lanes b) { return _mm_mul_epu32(a, b); }
+  lanes shift_left64(lanes a) { return _mm_slli_epi64(a, 32); }
+  lanes shift_right64(lanes a) { return _mm_srli_epi64(a, 32); }
+  lanes low_mask() { return _mm_set1_epi64x(0xffffffff); }
+  lanes iota() { return _mm_setr_epi32(0, 1, 2, 3); }
+  flanes to_unit(lanes x) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(0x1p-24f));
+  }
+  flanes fset(float f) { return _mm_set1_ps(f); }
+#if defined(__FMA__)
+  flanes scale(flanes u, flanes lo, flanes span) { return _mm_fmadd_ps(span, u, lo); }
+#else
+  flanes scale(flanes u, flanes lo, flanes span) { return _mm_add_ps(lo, _mm_mul_ps(span, u)); }
+#endif
+  void store(float* p, flanes a) { _mm_storeu_ps(p, a); }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  // mulhilo for every lane: the even lanes multiply directly and the odd
+  // lanes are shifted down into even positions first.
+  void mulhilo(lanes a, lanes m, lanes& lo, lanes& hi) {
+    const lanes even = mul_even(a, m);
+    const lanes odd = mul_even(shift_right64(a), m);
+    lo = bit_or(bit_and(even, low_mask()), shift_left64(odd));
+    hi = bit_or(shift_right64(even), bit_andnot(low_mask(), odd));
+  }
+
+  // Philox on one block per lane, for blocks first, first + 1, ...  The low
+  // word of the position must not wrap partway through.
+  void blocks(uint64_t first, uint64_t stream, const uint32_t key[2], lanes out[4]) {
+    lanes c0 = add(set((uint32_t)first), iota());
+    lanes c1 = set((uint32_t)(first >> 32));
+    lanes c2 = set((uint32_t)stream);
+    lanes c3 = set((uint32_t)(stream >> 32));
+
+    uint32_t k0 = key[0], k1 = key[1];
+    const lanes m0 = set(kM0), m1 = set(kM1);
+    for (int r = 0; r < kRounds; ++r) {
+      lanes lo0, hi0, lo1, hi1;
+      mulhilo(c0, m0, lo0, hi0);
+      mulhilo(c2, m1, lo1, hi1);
+      const lanes n0 = bit_xor(bit_xor(hi1, c1), set(k0));
+      const lanes n2 = bit_xor(bit_xor(hi0, c3), set(k1));
+      c0 = n0;
+      c1 = lo1;
+      c2 = n2;
+      c3 = lo0;
+      k0 += kW0;
+      k1 += kW1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+#endif
+}
+
+Rng::Rng(uint64_t seed, uint64_t stream) :
+  seed_(seed), stream_(stream),
+  key_{ (uint32_t)seed, (uint32_t)(seed >> 32) },
+  position_(0), buffer_{}, used_(4) {}
+
+// A block that was partly handed out is worked out again to get the rest.
+Rng::Rng(const State& state) : Rng(state.seed, state.stream) {
+  position_ = state.position;
+  if (state.used < 4 && position_ > 0) {
+    --position_;
+    refill();
+    used_ = (unsigned int)state.used;
+  }
+}
+
+void Rng::block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+  uint32_t c[4] = { counter[0], counter[1], counter[2], counter[3] };
+  uint32_t k0 = key[0], k1 = key[1];
+
+  for (int r = 0; r < kRounds; ++r) {
+    uint32_t lo0, hi0, lo1, hi1;
+    mulhilo(kM0, c[0], lo0, hi0);
+    mulhilo(kM1, c[2], lo1, hi1);
+    c[0] = hi1 ^ c[1] ^ k0;
+    c[1] = lo1;
+    c[2] = hi0 ^ c[3] ^ k1;
+    c[3] = lo0;
+    k0 += kW0;
+    k1 += kW1;
+  }
+
+  std::copy(c, c + 4, out);
+}
+
+void Rng::refill() {
+  const uint32_t counter[4] = {
+    (uint32_t)position_, (uint32_t)(position_ >> 32),
+    (uint32_t)stream_, (uint32_t)(stream_ >> 32) };
+  block(counter, key_, buffer_);
+  ++position_;
+  used_ = 0;
+}
+
+uint32_t Rng::next() {
+  if (used_ == 4) refill();
+  return buffer_[used_++];
+}
+
+float Rng::uniform(float lo, float hi) {
+  return scale(next(), lo, hi - lo);
+}
+
+// Multiply and shift rather than modulo.  The bias for ranges this small is
+// far below anything the game could notice.
+int Rng::uniform_int(int lo, int hi) {
+  const uint64_t range = (uint64_t)((int64_t)hi - lo) + 1;
+  return lo + (int)((next() * range) >> 32);
+}
+
+void Rng::fill(float* out, size_t n, float lo, float hi) {
+  size_t i = 0;
+
+  // finish the block that was already started
+  for (; i < n && used_ < 4; ++i) out[i] = uniform(lo, hi);
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  const flanes flo = fset(lo), fspan = fset(hi - lo);
+  float words[4][kWidth];
+
+  for (; i + 4 * kWidth <= n && (uint32_t)position_ <= UINT32_MAX - (kWidth - 1); i += 4 * kWidth) {
+    lanes x[4];
+    blocks(position_, stream_, key_, x);
+    position_ += kWidth;
+
+    for (int k = 0; k < 4; ++k) store(words[k], scale(to_unit(x[k]), flo, fspan));
+    for (size_t b = 0; b < kWidth; ++b) {
+      for (int k = 0; k < 4; ++k) out[i + 4 * b + k] = words[k][b];
+    }
+  }
+#endif
+
+  for (; i < n; ++i) out[i] = uniform(lo, hi);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counter based random numbers using Philox4x32-10.  Every block of four
+// values is a pure function of the key, the stream and the block's position,
+// so there is no state to share: any number of streams can be drawn from at
+// once, on any thread and in any order, and still give the same numbers for
+// the same seed.  fill() works out several blocks at a time with SIMD.
+class Rng {
+  public:
+
+    // Everything needed to carry on exactly where a generator left off.
+    struct State {
+      uint64_t seed, stream;
+      uint64_t position;
+      uint64_t used;
+    };
+
+    explicit Rng(uint64_t seed, uint64_t stream = 0);
+    explicit Rng(const State& state);
+
+    State state() const { return { seed_, stream_, position_, used_ }; }
+
+    // An independent generator with the same seed, e.g. one per thread or
+    // per entity.
+    Rng substream(uint64_t stream) const { return Rng(seed_, stream); }
+
+    uint32_t next();
+
+    // uniform in [lo, hi)
+    float uniform(float lo, float hi);
+
+    // uniform in [lo, hi], like std::uniform_int_distribution
+    int uniform_int(int lo, int hi);
+
+    // The same n values that calling uniform(lo, hi) n times would give.
+    void fill(float* out, size_t n, float lo, float hi);
+
+    // The raw block for a counter, for checking against published values.
+    static void block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+
+  private:
+
+    uint64_t seed_, stream_;
+    uint32_t key_[2];
+    uint64_t position_;  // next block to generate
+    uint32_t buffer_[4];
+    unsigned int used_;  // how much of buffer_ has been handed out
+
+    void refill();
+};
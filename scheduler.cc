@@ -0,0 +1,53 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace {
+  bool overlap(const std::vector<std::type_index>& a, const std::vector<std::type_index>& b) {
+    return std::any_of(a.begin(), a.end(), [&b](const std::type_index& t) {
+      return std::find(b.begin(), b.end(), t) != b.end();
+    });
+  }
+}
+
+void Scheduler::add(const char* name, std::vector<std::type_index> reads, std::vector<std::type_index> writes, System system) {
+  const size_t n = nodes_.size();
+  nodes_.push_back({ name, std::move(reads), std::move(writes), std::move(system), {}, 0 });
+
+  Node& node = nodes_.back();
+  for (size_t i = 0; i < n; ++i) {
+    Node& prior = nodes_[i];
+    if (overlap(node.writes, prior.writes) || overlap(node.writes, prior.reads) || overlap(node.reads, prior.writes)) {
+      prior.dependents.push_back(n);
+      ++node.dependencies;
+    }
+  }
+
+  waiting_ = std::make_unique<std::atomic<size_t>[]>(nodes_.size());
+}
+
+void Scheduler::run(float t) {
+  t_ = t;
+  pending_ = nodes_.size();
+
+  for (size_t i = 0; i < nodes_.size(); ++i) waiting_[i] = nodes_[i].dependencies;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    if (nodes_[i].dependencies == 0) start(i);
+  }
+
+  pool_.wait(pending_);
+}
+
+// The task only captures what fits in std::function without allocating.
+void Scheduler::start(size_t i) {
+  pool_.submit([this, i] {
+    const Node& node = nodes_[i];
+    profiler_.time(node.name, [&] { node.system(t_); });
+
+    for (const size_t d : node.dependents) {
+      if (waiting_[d].fetch_sub(1, std::memory_order_acq_rel) == 1) start(d);
+    }
+
+    pending_.fetch_sub(1, std::memory_order_release);
+  });
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+#include "profiler.h"
+#include "thread_pool.h"
+
+template <typename... T> struct Reads {};
+template <typename... T> struct Writes {};
+
+// Runs systems on a thread pool while keeping the order they were added in
+// wherever it matters.  Each system lists what it reads and writes, usually
+// components but any type can stand in for a shared resource.  A system waits
+// for every earlier system it conflicts with; anything else runs alongside.
+class Scheduler {
+  public:
+
+    using System = std::function<void(float)>;
+
+    Scheduler(ThreadPool& pool, Profiler& profiler) : pool_(pool), profiler_(profiler), t_(0), pending_(0) {}
+
+    template <typename... R, typename... W, typename F>
+    void add(const char* name, Reads<R...>, Writes<W...>, F&& f) {
+      add(name, { typeid(R)... }, { typeid(W)... }, System(std::forward<F>(f)));
+    }
+
+    void run(float t);
+
+  private:
+
+    struct Node {
+      const char* name;
+      std::vector<std::type_index> reads, writes;
+      System system;
+      std::vector<size_t> dependents;
+      size_t dependencies = 0;
+    };
+
+    ThreadPool& pool_;
+    Profiler& profiler_;
+    std::vector<Node> nodes_;
+    std::unique_ptr<std::atomic<size_t>[]> waiting_;
+
+    // the run in progress
+    float t_;
+    std::atomic<size_t> pending_;
+
+    void add(const char* name, std::vector<std::type_index> reads, std::vector<std::type_index> writes, System system);
+    void start(size_t i);
+};
@@ -0,0 +1,192 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+  constexpr char kMagic[4] = { 'S', 'Q', 'Z', 'S' };
+  constexpr uint32_t kVersion = 1;
+  constexpr size_t kAlign = 16;
+
+  struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t blocks;
+    uint32_t reserved;
+  };
+
+  struct BlockHeader {
+    uint32_t tag;
+    uint32_t size;
+    uint64_t count;
+    uint64_t in_use;
+    uint32_t entities;  // 1 if count ids come before the elements
+    uint32_t reserved;
+  };
+
+  static_assert(sizeof(FileHeader) == 16 && sizeof(BlockHeader) == 32);
+
+  size_t padded(size_t bytes) {
+    return (bytes + kAlign - 1) / kAlign * kAlign;
+  }
+}
+
+void SnapshotWriter::begin(uint32_t tag, uint32_t size) {
+  finish();
+  open_ = true;
+  tag_ = tag;
+  size_ = size;
+}
+
+void SnapshotWriter::raw(uint32_t tag, uint32_t size, size_t count, const void* data) {
+  finish();
+
+  const BlockHeader header { tag, size, count, 0, 0, 0 };
+  append(&header, sizeof(header));
+  append(data, count * size);
+  ++blocks_;
+}
+
+// The first count of a block is its length.  Only the entity pool has a
+// second, how many of its ids are in use.
+void SnapshotWriter::operator()(count_type n) {
+  if (counts_++ == 0) count_ = n;
+  in_use_ = n;
+}
+
+void SnapshotWriter::finish() {
+  if (!open_) return;
+
+  const BlockHeader header { tag_, size_, count_, in_use_, 1, 0 };
+  append(&header, sizeof(header));
+  append(ids_.data(), ids_.size() * sizeof(entt::entity));
+  append(data_.data(), data_.size());
+  ++blocks_;
+
+  open_ = false;
+  counts_ = 0;
+  count_ = in_use_ = 0;
+  ids_.clear();
+  data_.clear();
+}
+
+void SnapshotWriter::append(const void* p, size_t bytes) {
+  const char* c = static_cast<const char*>(p);
+  body_.insert(body_.end(), c, c + bytes);
+  body_.resize(padded(body_.size()));
+}
+
+bool SnapshotWriter::write(const std::string& path) {
+  finish();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) return false;
+
+  FileHeader header {};
+  std::copy(kMagic, kMagic + sizeof(kMagic), header.magic);
+  header.version = kVersion;
+  header.blocks = blocks_;
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(body_.data(), body_.size());
+  return out.good();
+}
+
+SnapshotFile::~SnapshotFile() {
+  close();
+}
+
+bool SnapshotFile::open(const std::string& path) {
+  close();
+
+  const char* base = nullptr;
+#if defined(__unix__) || defined(__APPLE__)
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      map_ = map;
+      bytes_ = (size_t)st.st_size;
+      base = static_cast<const char*>(map);
+    }
+  }
+  ::close(fd);
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (in) {
+    bytes_ = (size_t)in.tellg();
+    copy_.resize((bytes_ + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+    in.seekg(0);
+    if (in.read(reinterpret_cast<char*>(copy_.data()), bytes_)) base = reinterpret_cast<const char*>(copy_.data());
+  }
+#endif
+  const auto fail = [this] {
+    close();
+    return false;
+  };
+  if (!base) return fail();
+
+  FileHeader header;
+  if (bytes_ < sizeof(header)) return fail();
+  std::memcpy(&header, base, sizeof(header));
+  if (!std::equal(kMagic, kMagic + sizeof(kMagic), header.magic) || header.version != kVersion) return fail();
+
+  // Every block has to fit, so what find() gives back can be trusted.
+  size_t at = sizeof(header);
+  for (uint32_t b = 0; b < header.blocks; ++b) {
+    BlockHeader bh;
+    if (bytes_ - at < sizeof(bh)) return fail();
+    std::memcpy(&bh, base + at, sizeof(bh));
+    at += sizeof(bh);
+
+    const size_t room = bytes_ - at;
+    if (bh.count > room || bh.in_use > bh.count || (bh.size > 0 && bh.count > room / bh.size)) return fail();
+
+    SnapshotBlock block;
+    block.tag = bh.tag;
+    block.size = bh.size;
+    block.count = bh.count;
+    block.in_use = bh.in_use;
+    if (bh.entities) {
+      const size_t ids = padded(bh.count * sizeof(entt::entity));
+      if (ids > bytes_ - at) return fail();
+      block.entities = reinterpret_cast<const entt::entity*>(base + at);
+      at += ids;
+    }
+
+    const size_t data = padded(bh.count * bh.size);
+    if (data > bytes_ - at) return fail();
+    block.data = base + at;
+    at += data;
+
+    blocks_.push_back(block);
+  }
+
+  return true;
+}
+
+const SnapshotBlock* SnapshotFile::find(uint32_t tag) const {
+  const auto it = std::find_if(blocks_.begin(), blocks_.end(), [tag](const SnapshotBlock& b) { return b.tag == tag; });
+  return it == blocks_.end() ? nullptr : &*it;
+}
+
+void SnapshotFile::close() {
+#if defined(__unix__) || defined(__APPLE__)
+  if (map_) munmap(map_, bytes_);
+#endif
+  map_ = nullptr;
+  bytes_ = 0;
+  copy_.clear();
+  blocks_.clear();
+}
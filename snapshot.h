@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "entt/entity/fwd.hpp"
+
+// Binary snapshot of a world, laid out to load straight from a mapped file.
+// After a 16 byte header come the blocks, each a 32 byte header followed by
+// up to two columns padded to 16 bytes: the entity ids of a pool, then its
+// elements end to end.  A loader hands the columns to a pool's bulk insert
+// without parsing anything.  Values are stored as they are in memory, so a
+// snapshot only loads into a build with the same layouts.
+
+struct SnapshotBlock {
+  uint32_t tag = 0;
+  uint32_t size = 0;  // bytes per element, 0 for empty components
+  size_t count = 0;
+  size_t in_use = 0;  // for the entity pool, how many ids at the front are alive
+  const entt::entity* entities = nullptr;  // count of them, or null
+  const void* data = nullptr;  // count * size bytes
+};
+
+// An output archive for entt::snapshot.  EnTT writes a pool as its length
+// then its entities with their components, and begin() says which block they
+// go in.  Plain arrays that aren't pools go in with raw().
+class SnapshotWriter {
+  public:
+
+    using count_type = std::underlying_type_t<entt::entity>;
+
+    void begin(uint32_t tag, uint32_t size);
+    void raw(uint32_t tag, uint32_t size, size_t count, const void* data);
+
+    void operator()(count_type n);
+    void operator()(entt::entity e) { ids_.push_back(e); }
+
+    template <typename T>
+    void operator()(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      const char* p = reinterpret_cast<const char*>(&value);
+      data_.insert(data_.end(), p, p + sizeof(T));
+    }
+
+    bool write(const std::string& path);
+
+  private:
+
+    std::vector<char> body_;
+    uint32_t blocks_ = 0;
+
+    // the block EnTT is writing
+    bool open_ = false;
+    uint32_t tag_ = 0, size_ = 0;
+    int counts_ = 0;
+    uint64_t count_ = 0, in_use_ = 0;
+    std::vector<entt::entity> ids_;
+    std::vector<char> data_;
+
+    void finish();
+    void append(const void* p, size_t bytes);
+};
+
+// A snapshot mapped into memory read only.  Blocks point into the mapping and
+// are good for as long as the file stays open.
+class SnapshotFile {
+  public:
+
+    SnapshotFile() = default;
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    // False if the file is missing or isn't a snapshot this build understands.
+    bool open(const std::string& path);
+
+    // null if there is no block with this tag
+    const SnapshotBlock* find(uint32_t tag) const;
+
+  private:
+
+    void* map_ = nullptr;
+    size_t bytes_ = 0;
+    std::vector<std::max_align_t> copy_;  // where there is no mmap
+    std::vector<SnapshotBlock> blocks_;
+
+    void close();
+};
+
+// An input archive for entt::snapshot_loader over the entity pool's block,
+// giving back its length, how many are in use and then the ids.
+class SnapshotIds {
+  public:
+
+    using count_type = std::underlying_type_t<entt::entity>;
+
+    explicit SnapshotIds(const SnapshotBlock& block) : block_(block) {}
+
+    void operator()(count_type& n) { n = (count_type)(counts_++ == 0 ? block_.count : block_.in_use); }
+    void operator()(entt::entity& e) { e = block_.entities[next_++]; }
+
+  private:
+
+    const SnapshotBlock& block_;
+    int counts_ = 0;
+    size_t next_ = 0;
+};
@@ -0,0 +1,42 @@
+#include "sound_events.h"
+
+#include <algorithm>
+
+namespace {
+  struct Info {
+    const char* file;
+    unsigned int length;  // ms, rounded up
+    size_t voices;
+  };
+
+  // Explosions ring on for twenty ticks, so they're the ones the cap holds
+  // back in a chain of kills.
+  constexpr Info kInfo[SoundEvents::kSamples] = {
+    { "shot.wav", 58, 4 },
+    { "hit.wav", 74, 4 },
+    { "explode.wav", 344, 3 },
+  };
+}
+
+const std::string& SoundEvents::name(Sample sample) {
+  static const std::array<std::string, kSamples> names = { kInfo[shot].file, kInfo[hit].file, kInfo[explode].file };
+  return names[sample];
+}
+
+void SoundEvents::mix(unsigned int ms, std::vector<Sample>& voices) {
+  now_ += ms;
+
+  for (size_t s = 0; s < kSamples; ++s) {
+    if (triggered_[s] == 0) continue;
+    triggers_ += triggered_[s];
+    triggered_[s] = 0;
+
+    const auto first = ends_[s].begin(), last = first + std::min(kInfo[s].voices, kMaxVoices);
+    const auto free = std::find_if(first, last, [this](uint64_t end) { return end <= now_; });
+    if (free == last) continue;
+
+    *free = now_ + kInfo[s].length;
+    voices.push_back((Sample)s);
+    ++voices_;
+  }
+}
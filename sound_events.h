@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sound effects the systems trigger during a tick, gathered up and mixed down
+// before any reach the mixer.  However many times a sample goes off in one
+// tick it starts one voice, and it never has more than its cap of voices
+// playing at once, so a swarm of kills costs the mixer no more than a shot.
+class SoundEvents {
+  public:
+
+    enum Sample { shot, hit, explode, kSamples };
+
+    // The sample's file, made once so playing one doesn't build a string.
+    static const std::string& name(Sample sample);
+
+    void trigger(Sample sample) { ++triggered_[sample]; }
+
+    // Ends a tick that was ms long, adding a voice to start to voices for
+    // each sample triggered during it that has one free.
+    void mix(unsigned int ms, std::vector<Sample>& voices);
+
+    // totals since construction
+    size_t triggers() const { return triggers_; }
+    size_t voices() const { return voices_; }
+
+  private:
+
+    static constexpr size_t kMaxVoices = 4;
+
+    std::array<uint32_t, kSamples> triggered_ = {};
+    std::array<std::array<uint64_t, kMaxVoices>, kSamples> ends_ = {};  // ms
+    uint64_t now_ = 0;
+    size_t triggers_ = 0, voices_ = 0;
+};
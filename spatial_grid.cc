@@ -0,0 +1,43 @@
+#include "spatial_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(float cell, float width, float height) :
+  cell_(cell),
+  columns_((int)std::ceil(width / cell) + 1),
+  rows_((int)std::ceil(height / cell) + 1),
+  start_(columns_ * rows_ + 1) {}
+
+void SpatialGrid::clear() {
+  added_.clear();
+  cell_of_.clear();
+}
+
+void SpatialGrid::insert(entt::entity e, const pos p, const pos v) {
+  added_.push_back({e, p, v});
+  cell_of_.push_back(row(p.y) * columns_ + column(p.x));
+}
+
+// Counting sort: size each cell, turn the sizes into offsets, then drop every
+// entry into the next free spot of its cell.  Entries in a cell keep the order
+// they were inserted in.
+void SpatialGrid::build() {
+  std::fill(start_.begin(), start_.end(), 0);
+  for (const uint32_t c : cell_of_) ++start_[c + 1];
+  for (size_t c = 1; c < start_.size(); ++c) start_[c] += start_[c - 1];
+
+  entries_.resize(added_.size());
+  next_.assign(start_.begin(), start_.end() - 1);
+  for (size_t i = 0; i < added_.size(); ++i) entries_[next_[cell_of_[i]]++] = added_[i];
+}
+
+// Anything off the edge of the world lands in the border cells.  Clamping never
+// pushes two points further apart so neighbors are still found.
+int SpatialGrid::column(float x) const {
+  return std::clamp((int)std::floor(x / cell_), 0, columns_ - 1);
+}
+
+int SpatialGrid::row(float y) const {
+  return std::clamp((int)std::floor(y / cell_), 0, rows_ - 1);
+}
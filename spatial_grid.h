@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "entt/entity/registry.hpp"
+
+#include "geometry.h"
+
+// Uniform grid of entities bucketed by position.  Entries are counting sorted
+// into one array with each cell a contiguous run, and every array keeps its
+// capacity across clear() so rebuilding every frame does not allocate once the
+// entry count stops growing.
+class SpatialGrid {
+  public:
+
+    struct Entry {
+      entt::entity e;
+      pos p;
+      pos v;  // velocity, for grids that need it
+    };
+
+    SpatialGrid(float cell, float width, float height);
+
+    void clear();
+    void insert(entt::entity e, const pos p, const pos v = {});
+
+    // Packs everything inserted since clear() into cells.  Must be called
+    // before query() and after the last insert().
+    void build();
+
+    // Calls f for every entry in the cells overlapping the square of the given
+    // radius around p.  Callers still need to do their own distance checks.
+    template <typename F>
+    void query(const pos p, float radius, F&& f) const {
+      query(rect{ p.x - radius, p.y - radius, p.x + radius, p.y + radius }, f);
+    }
+
+    // Calls f for every entry in the cells overlapping r.
+    template <typename F>
+    void query(const rect r, F&& f) const {
+      const int c1 = column(r.left), c2 = column(r.right);
+      const int r1 = row(r.top), r2 = row(r.bottom);
+
+      // cells in a row are next to each other
+      for (int y = r1; y <= r2; ++y) {
+        const uint32_t end = start_[y * columns_ + c2 + 1];
+        for (uint32_t i = start_[y * columns_ + c1]; i < end; ++i) f(entries_[i]);
+      }
+    }
+
+  private:
+
+    float cell_;
+    int columns_, rows_;
+
+    // entries as inserted, with their cells
+    std::vector<Entry> added_;
+    std::vector<uint32_t> cell_of_;
+
+    // entries sorted by cell, where cell c is [start_[c], start_[c + 1])
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> start_, next_;
+
+    int column(float x) const;
+    int row(float y) const;
+};
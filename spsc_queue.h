@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Fixed size lock free queue for exactly one producer and one consumer thread.
+template <typename T, size_t N>
+class SpscQueue {
+  public:
+
+    // Returns false, dropping the value, if the queue is full.
+    bool push(const T& value) {
+      const size_t tail = tail_.load(std::memory_order_relaxed);
+      const size_t next = (tail + 1) % N;
+      if (next == head_.load(std::memory_order_acquire)) return false;
+
+      items_[tail] = value;
+      tail_.store(next, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T& value) {
+      const size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire)) return false;
+
+      value = items_[head];
+      head_.store((head + 1) % N, std::memory_order_release);
+      return true;
+    }
+
+  private:
+
+    std::array<T, N> items_;
+    alignas(64) std::atomic<size_t> head_ { 0 };
+    alignas(64) std::atomic<size_t> tail_ { 0 };
+};
@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+
+namespace {
+  thread_local const ThreadPool* current_pool = nullptr;
+  thread_local size_t current_index = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threads) : queued_(0), done_(false) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  threads = 1;
+#endif
+
+  for (unsigned int i = 0; i < threads; ++i) queues_.push_back(std::make_unique<Queue>());
+  for (unsigned int i = 0; i + 1 < threads; ++i) workers_.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    done_ = true;
+  }
+  wake_.notify_all();
+
+  for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::Queue::push_back(std::function<void()>&& task) {
+  if (count == slots.size()) {
+    std::vector<std::function<void()>> grown(std::max<size_t>(64, 2 * slots.size()));
+    for (size_t i = 0; i < count; ++i) grown[i] = std::move(slots[(head + i) % slots.size()]);
+    slots.swap(grown);
+    head = 0;
+  }
+  slots[(head + count++) % slots.size()] = std::move(task);
+}
+
+std::function<void()> ThreadPool::Queue::pop_back() {
+  return std::move(slots[(head + --count) % slots.size()]);
+}
+
+std::function<void()> ThreadPool::Queue::pop_front() {
+  std::function<void()> task = std::move(slots[head]);
+  head = (head + 1) % slots.size();
+  --count;
+  return task;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  Queue& q = *queues_[home()];
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.push_back(std::move(task));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    ++queued_;
+  }
+  wake_.notify_one();
+}
+
+void ThreadPool::wait(const std::atomic<size_t>& pending) {
+  const size_t me = home();
+  while (pending.load(std::memory_order_acquire) > 0) {
+    if (!run_one(me)) std::this_thread::yield();
+  }
+}
+
+size_t ThreadPool::home() const {
+  return current_pool == this ? current_index : queues_.size() - 1;
+}
+
+bool ThreadPool::run_one(size_t home) {
+  std::function<void()> task;
+
+  {
+    Queue& q = *queues_[home];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.count > 0) task = q.pop_back();
+  }
+
+  for (size_t i = 1; !task && i < queues_.size(); ++i) {
+    Queue& q = *queues_[(home + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.count > 0) task = q.pop_front();
+  }
+
+  if (!task) return false;
+
+  --queued_;
+  task();
+  return true;
+}
+
+void ThreadPool::work(size_t index) {
+  current_pool = this;
+  current_index = index;
+
+  while (true) {
+    if (run_one(index)) continue;
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return done_ || queued_ > 0; });
+    if (done_) return;
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool.  Every worker has its own queue and takes from the back
+// of it, falling back to stealing from the front of the others.  Threads that
+// wait on the pool run queued tasks instead of blocking, so tasks can safely
+// spawn more work and wait for it.
+class ThreadPool {
+  public:
+
+    // threads counts the calling thread, so 1 means no workers at all and 0
+    // means one thread per core.  Builds without threads, like the web one,
+    // always get 1.
+    explicit ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size() + 1; }
+
+    void submit(std::function<void()> task);
+
+    // Runs tasks until pending drops to zero.
+    void wait(const std::atomic<size_t>& pending);
+
+    // Calls f(begin, end) for chunks covering [0, n) and returns once they have
+    // all finished.
+    template <typename F>
+    void parallel_for(size_t n, size_t chunk, F&& f) {
+      if (n == 0) return;
+      if (workers_.empty() || n <= chunk) {
+        f((size_t)0, n);
+        return;
+      }
+
+      // Tasks only capture what fits in std::function without allocating.
+      struct Job {
+        F& f;
+        size_t n, chunk;
+        std::atomic<size_t> pending;
+      } job { f, n, chunk, (n + chunk - 1) / chunk };
+
+      for (size_t begin = 0; begin < n; begin += chunk) {
+        submit([&job, begin] {
+          job.f(begin, std::min(begin + job.chunk, job.n));
+          job.pending.fetch_sub(1, std::memory_order_release);
+        });
+      }
+      wait(job.pending);
+    }
+
+  private:
+
+    // A ring of task slots that only grows when it fills, so once it has
+    // seen the busiest frame queueing work never allocates.
+    struct Queue {
+      std::mutex mutex;
+      std::vector<std::function<void()>> slots;
+      size_t head = 0, count = 0;
+
+      void push_back(std::function<void()>&& task);
+      std::function<void()> pop_back();
+      std::function<void()> pop_front();
+    };
+
+    // one queue per worker plus a shared one for threads outside the pool
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<size_t> queued_;
+    std::atomic<bool> done_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    size_t home() const;
+    bool run_one(size_t home);
+    void work(size_t index);
+};
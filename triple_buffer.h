@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock free hand off of whole values from one producer thread to one consumer
+// thread.  The producer fills back() and publishes it; the consumer picks up
+// the newest published value with update() and reads it from front().  Neither
+// side ever waits and the consumer never sees a half written value.
+template <typename T>
+class TripleBuffer {
+  public:
+
+    T& back() { return buffers_[back_]; }
+    const T& front() const { return buffers_[front_]; }
+
+    // Calls f on all three buffers, to set them up before either thread
+    // starts using them.
+    template <typename F>
+    void each(F&& f) {
+      for (T& buffer : buffers_) f(buffer);
+    }
+
+    void publish() {
+      const uint8_t old = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+      back_ = old & kIndex;
+    }
+
+    // Returns true if there was something new to pick up.
+    bool update() {
+      if (!(middle_.load(std::memory_order_relaxed) & kFresh)) return false;
+
+      const uint8_t old = middle_.exchange(front_, std::memory_order_acq_rel);
+      front_ = old & kIndex;
+      return true;
+    }
+
+  private:
+
+    static constexpr uint8_t kIndex = 0x03;
+    static constexpr uint8_t kFresh = 0x04;
+
+    T buffers_[3];
+    uint8_t back_ = 0, front_ = 1;
+    std::atomic<uint8_t> middle_ { 2 };
+};